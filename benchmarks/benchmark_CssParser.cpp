@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "CssParser.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+/*! Measures parse time over style sheets of growing size
+ *
+ * Parse time has to grow linearly with the number of rules, i.e. the
+ * "ns/rule" column should stay roughly constant from 1k to 100k rules.  All
+ * parser backends are measured for comparison.
+ */
+
+namespace
+{
+
+std::string makeStyleSheet(int numberOfRules)
+{
+  std::ostringstream ss;
+  for (int i = 0; i < numberOfRules; ++i) {
+    ss << "/* rule " << i << " */\n"
+       << "Panel" << (i % 97) << " > Button.item" << i << ", .label" << i << " {\n"
+       << "  color: #" << std::hex << (i % 0xffffff) << std::dec << ";\n"
+       << "  font: \"italic 12px Arial\";\n"
+       << "  margin: 4, 8, 4, 8;\n"
+       << "  background: rgba(10, 20, 30, 0.5);\n"
+       << "}\n";
+  }
+  return ss.str();
+}
+
+} // anon namespace
+
+int main()
+{
+  using namespace aqt::stylesheets;
+  using Clock = std::chrono::steady_clock;
+
+  std::cout << std::setw(20) << "parser" << std::setw(10) << "rules" << std::setw(12)
+            << "bytes" << std::setw(12) << "ms" << std::setw(12) << "ns/rule"
+            << std::endl;
+
+  const auto backends = {std::make_pair("spirit", ParserBackend::kSpirit),
+                         std::make_pair("recursive-descent",
+                                        ParserBackend::kRecursiveDescent)};
+
+  for (const auto& backend : backends) {
+    for (auto numberOfRules : {1000, 10000, 100000}) {
+      const auto src = makeStyleSheet(numberOfRules);
+
+      const auto start = Clock::now();
+      const auto styleSheet = parseStdString(src, backend.second);
+      const auto elapsed =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+      if (styleSheet.propsets.size() != size_t(numberOfRules)) {
+        std::cerr << "Unexpected number of rules parsed" << std::endl;
+        return 1;
+      }
+
+      std::cout << std::setw(20) << backend.first << std::setw(10) << numberOfRules
+                << std::setw(12) << src.size() << std::setw(12)
+                << elapsed.count() / 1000000 << std::setw(12)
+                << elapsed.count() / numberOfRules << std::endl;
+    }
+  }
+
+  return 0;
+}
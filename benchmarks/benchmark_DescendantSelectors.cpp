@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "CssParser.hpp"
+#include "StyleMatchTree.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*! Stresses matching of selectors with many descendant combinators
+ *
+ * Selectors like "A B C D E F" against deep paths made of the same few
+ * types are the worst case for descendant matching: every ancestor is a
+ * candidate for every combinator.  The time per match should grow about
+ * linearly with the depth of the path.
+ */
+
+namespace
+{
+
+std::string makeStyleSheet()
+{
+  std::ostringstream ss;
+  ss << "A B C D E F { color: red; }\n"
+     << "A B C D E F G { color: blue; }\n"
+     << "A A A A A A A A Z { color: green; }\n"
+     << ".a .b .c .d .e F { width: 1; }\n"
+     << "A > B C > D E > F { height: 2; }\n";
+  return ss.str();
+}
+
+aqt::stylesheets::UiItemPath makePath(int depth)
+{
+  using aqt::stylesheets::PathElement;
+
+  aqt::stylesheets::UiItemPath path;
+  for (int i = 0; i < depth - 1; ++i) {
+    const auto type = std::string(1, char('A' + i % 5));
+    path.emplace_back(type, std::vector<std::string>{std::string(1, char('a' + i % 5))});
+  }
+  path.emplace_back("F");
+  return path;
+}
+
+} // anon namespace
+
+int main()
+{
+  using namespace aqt::stylesheets;
+  using Clock = std::chrono::steady_clock;
+
+  const int kIterations = 1000;
+
+  auto tree = createMatchTree(parseStdString(makeStyleSheet()));
+  auto scratch = createMatchScratch();
+
+  std::cout << std::setw(8) << "depth" << std::setw(12) << "properties"
+            << std::setw(14) << "ns/match" << std::endl;
+
+  for (auto depth : {10, 20, 30, 40, 60, 120}) {
+    const auto path = makePath(depth);
+
+    const auto numberOfProperties =
+      findMatchingProperties(tree.get(), path, scratch.get());
+
+    const auto start = Clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      findMatchingProperties(tree.get(), path, scratch.get());
+    }
+    const auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+      / kIterations;
+
+    std::cout << std::setw(8) << depth << std::setw(12) << numberOfProperties
+              << std::setw(14) << ns << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,203 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "CssParser.hpp"
+#include "StyleMatchTree.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*! Measures the cost of matching paths and counts its heap allocations
+ *
+ * findMatchingProperties() must not allocate once its scratch buffer is
+ * warmed up, neither for a path nor for a match state, which is what the
+ * StyleSnapshot uses; the benchmark fails otherwise.  matchPath()
+ * additionally builds the resulting property map, whose allocations are
+ * reported for comparison.
+ *
+ * Last it compares resolving many sibling items through matchPath() to
+ * resolving them from the match state of their parent path.
+ */
+
+namespace
+{
+
+std::atomic<long> sAllocations(0);
+
+std::string makeStyleSheet(int numberOfRules)
+{
+  std::ostringstream ss;
+  for (int i = 0; i < numberOfRules; ++i) {
+    ss << "Panel" << (i % 37) << " Button.item" << (i % 101) << ", Panel" << (i % 37)
+       << " > .label" << (i % 13) << " {\n"
+       << "  color: #" << std::hex << (i % 0xffffff) << std::dec << ";\n"
+       << "  margin: 4, 8, 4, 8;\n"
+       << "}\n";
+  }
+  ss << "Button { font: \"italic 12px Arial\"; }\n";
+  return ss.str();
+}
+
+aqt::stylesheets::UiItemPath makePath(int depth)
+{
+  using aqt::stylesheets::PathElement;
+
+  aqt::stylesheets::UiItemPath path;
+  for (int i = 0; i < depth - 1; ++i) {
+    path.emplace_back("Panel" + std::to_string(i % 37),
+                      std::vector<std::string>{"label" + std::to_string(i % 13)});
+  }
+  path.emplace_back("Button", std::vector<std::string>{"item7", "label3"});
+  return path;
+}
+
+} // anon namespace
+
+void* operator new(std::size_t size)
+{
+  ++sAllocations;
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+int main()
+{
+  using namespace aqt::stylesheets;
+  using Clock = std::chrono::steady_clock;
+
+  const int kIterations = 10000;
+
+  auto tree = createMatchTree(parseStdString(makeStyleSheet(1000)));
+  auto scratch = createMatchScratch();
+
+  std::cout << std::setw(8) << "depth" << std::setw(12) << "properties"
+            << std::setw(16) << "kernel allocs" << std::setw(14) << "kernel ns"
+            << std::setw(16) << "state allocs" << std::setw(14) << "state ns"
+            << std::setw(18) << "matchPath allocs" << std::setw(14) << "matchPath ns"
+            << std::endl;
+
+  for (auto depth : {1, 5, 10, 20}) {
+    const auto path = makePath(depth);
+
+    auto state = createMatchState(tree.get());
+    for (const auto& element : path) {
+      state = extendMatchState(state, element);
+    }
+
+    // warm up the scratch buffer
+    const auto numberOfProperties =
+      findMatchingProperties(tree.get(), path, scratch.get());
+    findMatchingProperties(state.get(), scratch.get());
+
+    auto allocs = sAllocations.load();
+    auto start = Clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      findMatchingProperties(tree.get(), path, scratch.get());
+    }
+    const auto kernelNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+      / kIterations;
+    const auto kernelAllocs = sAllocations.load() - allocs;
+
+    allocs = sAllocations.load();
+    start = Clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      findMatchingProperties(state.get(), scratch.get());
+    }
+    const auto stateNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+      / kIterations;
+    const auto stateAllocs = sAllocations.load() - allocs;
+
+    allocs = sAllocations.load();
+    start = Clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      matchPath(state.get(), scratch.get());
+    }
+    const auto matchNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+      / kIterations;
+    const auto matchAllocs = (sAllocations.load() - allocs) / kIterations;
+
+    std::cout << std::setw(8) << depth << std::setw(12) << numberOfProperties
+              << std::setw(16) << kernelAllocs << std::setw(14) << kernelNs
+              << std::setw(16) << stateAllocs << std::setw(14) << stateNs
+              << std::setw(18) << matchAllocs << std::setw(14) << matchNs << std::endl;
+
+    if (kernelAllocs != 0 || stateAllocs != 0) {
+      std::cerr << "The matching kernel allocated memory" << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << std::endl
+            << std::setw(8) << "depth" << std::setw(18) << "matchPath ns"
+            << std::setw(18) << "match state ns" << std::endl;
+
+  const int kSiblings = 1000;
+
+  for (auto depth : {5, 10, 20, 40}) {
+    auto path = makePath(depth);
+
+    auto start = Clock::now();
+    for (int i = 0; i < kSiblings; ++i) {
+      path.back().mClassNames[0] = internAtom("item" + std::to_string(i % 101));
+      matchPath(tree.get(), path, scratch.get());
+    }
+    const auto pathNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+      / kSiblings;
+
+    auto parentState = createMatchState(tree.get());
+    for (auto it = path.begin(); it != std::prev(path.end()); ++it) {
+      parentState = extendMatchState(parentState, *it);
+    }
+
+    start = Clock::now();
+    for (int i = 0; i < kSiblings; ++i) {
+      path.back().mClassNames[0] = internAtom("item" + std::to_string(i % 101));
+      matchPath(extendMatchState(parentState, path.back()).get(), scratch.get());
+    }
+    const auto stateNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()
+      / kSiblings;
+
+    std::cout << std::setw(8) << depth << std::setw(18) << pathNs << std::setw(18)
+              << stateNs << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "Atom.hpp"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+namespace
+{
+
+class AtomTable
+{
+public:
+  AtomId intern(const std::string& name)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mAtoms.find(name);
+    if (it != mAtoms.end()) {
+      return it->second;
+    }
+
+    const auto atom = static_cast<AtomId>(mNames.size());
+    mNames.push_back(name);
+    mAtoms.emplace(name, atom);
+    return atom;
+  }
+
+  AtomId find(const std::string& name)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mAtoms.find(name);
+    return it != mAtoms.end() ? it->second : kNoAtom;
+  }
+
+  const std::string& name(AtomId atom)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mNames[atom];
+  }
+
+  std::size_t size()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mNames.size();
+  }
+
+private:
+  std::mutex mMutex;
+  std::unordered_map<std::string, AtomId> mAtoms;
+  // a deque never moves its elements, which keeps references to names valid
+  std::deque<std::string> mNames;
+};
+
+AtomTable& atomTable()
+{
+  static AtomTable sAtomTable;
+  return sAtomTable;
+}
+
+} // anon namespace
+
+AtomId internAtom(const std::string& name)
+{
+  return atomTable().intern(name);
+}
+
+AtomId findAtom(const std::string& name)
+{
+  return atomTable().find(name);
+}
+
+const std::string& atomName(AtomId atom)
+{
+  return atomTable().name(atom);
+}
+
+std::size_t atomCount()
+{
+  return atomTable().size();
+}
+
+} // namespace stylesheets
+} // namespace aqt
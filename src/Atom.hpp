@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+/*! @cond DOXYGEN_IGNORE */
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+/*! Small integer id of an interned name
+ *
+ * Type names, class names and property names are interned in a process
+ * wide table, so that matching compares and hashes integers instead of
+ * strings.  Atoms are never released; the number of distinct names in an
+ * application is small.
+ */
+using AtomId = std::uint32_t;
+
+/*! Returns the atom for @p name, adding it to the table if needed
+ *
+ * This function is thread safe. */
+AtomId internAtom(const std::string& name);
+
+//! The atom findAtom() returns for names not interned
+const AtomId kNoAtom = std::numeric_limits<AtomId>::max();
+
+/*! Returns the atom for @p name or kNoAtom if it has not been interned
+ *
+ * Unlike internAtom() this never adds to the table, which is preferable for
+ * names which are only looked up.  This function is thread safe. */
+AtomId findAtom(const std::string& name);
+
+/*! Returns the name of @p atom
+ *
+ * The reference stays valid for the lifetime of the process.  This function
+ * is thread safe. */
+const std::string& atomName(AtomId atom);
+
+//! Returns the number of atoms interned so far
+std::size_t atomCount();
+
+} // namespace stylesheets
+} // namespace aqt
+
+/*! @endcond */
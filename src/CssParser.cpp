@@ -21,40 +21,26 @@ THE SOFTWARE.
 */
 
 #include "CssParser.hpp"
+#include "CssRecursiveParser.hpp"
+#include "Log.hpp"
 
 #include "Warnings.hpp"
 
 SUPPRESS_WARNINGS
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
 #include <boost/fusion/include/adapt_struct.hpp>
 #include <boost/spirit/include/phoenix_fusion.hpp>
 #include <boost/spirit/include/phoenix_operator.hpp>
 #include <boost/spirit/include/phoenix_stl.hpp>
 #include <boost/spirit/include/qi.hpp>
-#include <boost/spirit/include/support_line_pos_iterator.hpp>
 RESTORE_WARNINGS
 
-#include <fstream>
-#include <iostream>
-#include <sstream>
-
-namespace
-{
-
-/*! @throw std::ios_base::failure for IO errors or if the file at @path
- *         could not be opened. */
-std::string loadFileIntoString(const std::string& path)
-{
-  std::stringstream result;
-
-  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
-  in.exceptions(std::ifstream::failbit);
-
-  result << in.rdbuf();
-
-  return result.str();
-}
-
-} // anon namespace
+#include <algorithm>
+#include <future>
+#include <ios>
+#include <system_error>
+#include <thread>
 
 // this must be outside of the anon namespace
 // clang-format off
@@ -95,6 +81,12 @@ namespace phoenix = boost::phoenix;
 namespace qi = boost::spirit::qi;
 namespace ascii = boost::spirit::ascii;
 
+/*! Records the byte offset of a parsed rule or property
+ *
+ * @p It must be a random access iterator, otherwise computing the offset is
+ * linear and parsing a complete style sheet gets quadratic.  Line and
+ * column numbers are resolved lazily through SourceLineIndex.
+ */
 template <typename It>
 class LocationAnnotator
 {
@@ -115,11 +107,7 @@ class LocationAnnotator
   template <typename ThingWithLocation>
   void operator()(ThingWithLocation& thing, It iter) const
   {
-    thing.mSourceLoc.mByteOfs = static_cast<int>(std::distance(mFirst, iter));
-    thing.mSourceLoc.mLine = static_cast<int>(get_line(iter));
-
-    // The column offset is always off by one. Why? It is a mystery.
-    thing.mSourceLoc.mColumn = static_cast<int>(get_column(mFirst, iter)) - 1;
+    thing.mSourceLoc.mByteOfs = static_cast<int>(iter - mFirst);
   }
 };
 
@@ -147,9 +135,11 @@ struct StyleSheetGrammar
 
     identifier      = +(qi::alnum | char_('-'));
     dot_identifier  = char_(".") >> identifier;
+    colon_identifier = char_(":") >> identifier;
     child_sel       = char_(">");
     sel_separator   = char_(",");
-    sel_part        = +(dot_identifier | identifier)[push_back(_val, _1)];
+    sel_part        = +(dot_identifier | colon_identifier | identifier)
+                        [push_back(_val, _1)];
     child_sel_part  = (child_sel)[push_back(_val, _1)];
     selector        = +(sel_part | child_sel_part)[push_back(_val, _1)];
 
@@ -209,6 +199,7 @@ struct StyleSheetGrammar
     fontfacedecl.name("fontface");
     identifier.name("identifier");
     dot_identifier.name("dot_identifier");
+    colon_identifier.name("pseudo_state");
     propset.name("propset");
     quoted_string.name("string");
     stylesheet.name("stylesheet");
@@ -232,6 +223,7 @@ struct StyleSheetGrammar
 
   qi::rule<Iterator, std::string()> identifier;
   qi::rule<Iterator, std::string()> dot_identifier;
+  qi::rule<Iterator, std::string()> colon_identifier;
   qi::rule<Iterator, std::string()> sel_separator;
   qi::rule<Iterator, std::string()> child_sel;
   qi::rule<Iterator, aqt::stylesheets::SelectorParts()> child_sel_part;
@@ -263,45 +255,278 @@ namespace aqt
 namespace stylesheets
 {
 
-StyleSheet parseStdString(const std::string& data)
+SourceLineIndex::SourceLineIndex()
+  : mLineStarts(1, 0)
+{
+}
+
+SourceLineIndex::SourceLineIndex(const char* first, const char* last)
+  : mLineStarts(1, 0)
+{
+  // "\r\n", "\n" and a single "\r" all count as one line break
+  for (const char* p = first; p != last; ++p) {
+    if (*p == '\n' || (*p == '\r' && (std::next(p) == last || *std::next(p) != '\n'))) {
+      mLineStarts.push_back(static_cast<int>(std::next(p) - first));
+    }
+  }
+}
+
+int SourceLineIndex::line(int byteOfs) const
+{
+  auto it = std::upper_bound(mLineStarts.begin(), mLineStarts.end(), byteOfs);
+  return static_cast<int>(std::distance(mLineStarts.begin(), it));
+}
+
+int SourceLineIndex::column(int byteOfs) const
+{
+  return byteOfs - mLineStarts[size_t(line(byteOfs) - 1)];
+}
+
+namespace detail
+{
+
+ParseException makeParseException(const std::string& msg,
+                                  const char* first,
+                                  const char* last,
+                                  const char* errorPos,
+                                  const SourceLineIndex& lineIndex)
+{
+  const auto errorOfs = static_cast<int>(errorPos - first);
+  const auto restLen = last - errorPos;
+
+  auto errorText = restLen > 128 ? std::string(errorPos, errorPos + 128) + "..."
+                                 : std::string(errorPos, last);
+
+  return ParseException(
+    msg, errorText, lineIndex.line(errorOfs), lineIndex.column(errorOfs));
+}
+
+std::vector<const char*> splitAtRuleBoundaries(const char* first,
+                                               const char* last,
+                                               std::size_t maxChunks,
+                                               std::ptrdiff_t minChunkSize)
+{
+  const auto chunkCount = std::max<std::ptrdiff_t>(std::ptrdiff_t(maxChunks), 1);
+  const auto chunkSize = std::max((last - first) / chunkCount, minChunkSize);
+
+  std::vector<const char*> bounds(1, first);
+  auto depth = 0;
+
+  for (const char* p = first; p != last; ++p) {
+    if (*p == '"' || *p == '\'') {
+      p = std::find(std::next(p), last, *p);
+    } else if (*p == '/' && std::next(p) != last && *std::next(p) == '/') {
+      p = std::find(p, last, '\n');
+    } else if (*p == '/' && std::next(p) != last && *std::next(p) == '*') {
+      const char kEnd[] = "*/";
+      p = std::search(std::next(p, 2), last, kEnd, kEnd + 2);
+      if (p != last) {
+        ++p;
+      }
+    } else if (*p == '{') {
+      ++depth;
+    } else if (*p == '}' && --depth == 0 && std::next(p) - bounds.back() >= chunkSize
+               && last - std::next(p) >= chunkSize) {
+      bounds.push_back(std::next(p));
+    }
+
+    if (p == last) {
+      break;
+    }
+  }
+
+  bounds.push_back(last);
+  return bounds;
+}
+
+} // namespace detail
+
+namespace
+{
+
+//! Sheets smaller than this are parsed in one go
+const std::ptrdiff_t kMinParallelChunkSize = 64 * 1024;
+
+StyleSheet parseWithSpirit(const char* source,
+                           const char* first,
+                           const char* last,
+                           const SourceLineIndex& lineIndex)
 {
   StyleSheet stylesheet;
 
-  using source_iterator = boost::spirit::line_pos_iterator<std::string::const_iterator>;
+  using source_iterator = const char*;
   using StrStyleSheetGrammar = StyleSheetGrammar<source_iterator>;
 
-  auto iter = source_iterator{data.begin()};
-  auto end = source_iterator{data.end()};
-  StrStyleSheetGrammar styleGrammar(iter);
+  auto iter = first;
+  StrStyleSheetGrammar styleGrammar(source);
 
-  bool retval =
-    phrase_parse(iter, end, styleGrammar, boost::spirit::ascii::space, stylesheet);
+  bool retval = false;
+  try {
+    retval =
+      phrase_parse(iter, last, styleGrammar, boost::spirit::ascii::space, stylesheet);
+  } catch (const qi::expectation_failure<source_iterator>& e) {
+    throw detail::makeParseException(
+      "Expected " + e.what_.tag, source, last, e.first, lineIndex);
+  }
 
-  if (retval && iter == end) {
+  if (retval && iter == last) {
     return stylesheet;
   }
 
-  if (iter != end) {
-    auto errorOfs = std::distance(source_iterator{data.begin()}, iter);
-    auto restLen = std::distance(iter, end);
+  if (iter != last) {
+    throw detail::makeParseException(
+      "Found unexpected tokens", source, last, iter, lineIndex);
+  } else {
+    throw ParseException("Unknown error");
+  }
+}
 
-    auto errorText = restLen > 128 ? data.substr(size_t(errorOfs), 128) + "..."
-                                   : data.substr(size_t(errorOfs), std::string::npos);
+StyleSheet parseChunk(const char* source,
+                      const char* first,
+                      const char* last,
+                      const SourceLineIndex& lineIndex,
+                      ParserBackend backend)
+{
+  return backend == ParserBackend::kRecursiveDescent
+           ? detail::parseRecursiveDescent(source, first, last, lineIndex)
+           : parseWithSpirit(source, first, last, lineIndex);
+}
 
-    throw ParseException("Found unexpected tokens", errorText);
+void appendStyleSheet(StyleSheet& stylesheet, StyleSheet&& other)
+{
+  std::move(other.propsets.begin(), other.propsets.end(),
+            std::back_inserter(stylesheet.propsets));
+  std::move(other.fontfaces.begin(), other.fontfaces.end(),
+            std::back_inserter(stylesheet.fontfaces));
+}
+
+StyleSheet parseRange(const char* first,
+                      const char* last,
+                      ParserBackend backend,
+                      std::size_t maxThreads)
+{
+  auto lineIndex = std::make_shared<const SourceLineIndex>(first, last);
+
+  StyleSheet stylesheet;
+
+  const auto bounds =
+    last - first >= 2 * kMinParallelChunkSize && maxThreads > 1
+      ? detail::splitAtRuleBoundaries(first, last, maxThreads, kMinParallelChunkSize)
+      : std::vector<const char*>{first, last};
+
+  if (bounds.size() > 2) {
+    // large sheets are parsed in chunks of top level rules in parallel.  The
+    // source locations stay relative to first, so appending the chunks in
+    // order keeps the propsets in source order.
+    try {
+      std::vector<std::future<StyleSheet>> chunks;
+      auto i = std::next(bounds.begin());
+      try {
+        for (; std::next(i) != bounds.end(); ++i) {
+          chunks.emplace_back(std::async(std::launch::async, parseChunk, first, *i,
+                                         *std::next(i), std::cref(*lineIndex), backend));
+        }
+      } catch (const std::system_error& e) {
+        // out of threads; the chunks not started yet are parsed on this one
+        styleSheetsLogWarning() << "Parsing style sheet chunks sequentially: "
+                                << e.what();
+      }
+
+      stylesheet = parseChunk(first, bounds[0], bounds[1], *lineIndex, backend);
+      for (auto& chunk : chunks) {
+        appendStyleSheet(stylesheet, chunk.get());
+      }
+      for (; std::next(i) != bounds.end(); ++i) {
+        appendStyleSheet(stylesheet,
+                         parseChunk(first, *i, *std::next(i), *lineIndex, backend));
+      }
+    } catch (const ParseException&) {
+      // a chunk doesn't see the context of its neighbours.  Parse the whole
+      // sheet again to report the error exactly like a sequential parse.
+      stylesheet = parseChunk(first, first, last, *lineIndex, backend);
+    }
   } else {
-    throw ParseException("Unknown error");
+    stylesheet = parseChunk(first, first, last, *lineIndex, backend);
   }
+
+  stylesheet.lineIndex = lineIndex;
+
+  return stylesheet;
+}
+
+ParserBackend builtinParserBackend()
+{
+#if defined(AQT_STYLESHEETS_RECURSIVE_DESCENT_PARSER)
+  return ParserBackend::kRecursiveDescent;
+#else
+  return ParserBackend::kSpirit;
+#endif
+}
+
+} // anon namespace
+
+ParserBackend defaultParserBackend()
+{
+  static const ParserBackend sBackend = []() -> ParserBackend {
+    const auto envValue = qgetenv("AQT_STYLESHEETS_PARSER");
+    if (envValue == "spirit") {
+      return ParserBackend::kSpirit;
+    } else if (envValue == "recursive-descent") {
+      return ParserBackend::kRecursiveDescent;
+    }
+    return builtinParserBackend();
+  }();
+
+  return sBackend;
+}
+
+StyleSheet parseStdString(const std::string& data)
+{
+  return parseStdString(data, defaultParserBackend());
+}
+
+StyleSheet parseStdString(const std::string& data, ParserBackend backend)
+{
+  return parseStdString(data, backend, std::thread::hardware_concurrency());
+}
+
+StyleSheet parseStdString(const std::string& data,
+                          ParserBackend backend,
+                          std::size_t maxThreads)
+{
+  return parseRange(data.data(), data.data() + data.size(), backend, maxThreads);
 }
 
 StyleSheet parseString(const QString& data)
 {
-  return parseStdString(data.toStdString());
+  const auto utf8 = data.toUtf8();
+  return parseRange(utf8.constData(), utf8.constData() + utf8.size(),
+                    defaultParserBackend(), std::thread::hardware_concurrency());
 }
 
 StyleSheet parseStyleFile(const QString& path)
 {
-  return parseStdString(loadFileIntoString(path.toStdString()));
+  return parseStyleFile(path, std::thread::hardware_concurrency());
+}
+
+StyleSheet parseStyleFile(const QString& path, std::size_t maxThreads)
+{
+  // The file is read rather than mapped: it may be rewritten in place while
+  // it is parsed, e.g. during a hot reload, and touching a mapped page past
+  // its new end raises SIGBUS.  If its size changed meanwhile its next change
+  // notification loads it again.
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    throw std::ios_base::failure("Could not open '" + path.toStdString() + "'");
+  }
+
+  const auto data = file.readAll();
+  if (file.error() != QFileDevice::NoError) {
+    throw std::ios_base::failure("Could not read '" + path.toStdString() + "'");
+  }
+
+  return parseRange(data.constData(), data.constData() + data.size(),
+                    defaultParserBackend(), maxThreads);
 }
 
 } // namespace stylesheets
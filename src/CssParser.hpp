@@ -31,6 +31,8 @@ SUPPRESS_WARNINGS
 #include <boost/variant/variant.hpp>
 RESTORE_WARNINGS
 
+#include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -66,19 +68,53 @@ class FontFaceDecl
   std::string url;
 };
 
+/*! Maps byte offsets into a style sheet source to line and column numbers
+ *
+ * The index of line start offsets is built in one pass over the source.
+ * Resolving an offset is a binary search over it, so that line numbers are
+ * only computed when someone actually asks for them (e.g. for error
+ * messages or describeMatchedPath()).
+ */
+class SourceLineIndex
+{
+public:
+  SourceLineIndex();
+  SourceLineIndex(const char* first, const char* last);
+
+  /*! Returns the 1-based line number of @p byteOfs */
+  int line(int byteOfs) const;
+  /*! Returns the 0-based column of @p byteOfs */
+  int column(int byteOfs) const;
+
+  /*! The byte offsets at which lines start, in ascending order */
+  const std::vector<int>& lineStarts() const
+  {
+    return mLineStarts;
+  }
+
+private:
+  std::vector<int> mLineStarts;
+};
+
 class StyleSheet
 {
 public:
   std::vector<PropertySpecSet> propsets;
   std::vector<FontFaceDecl> fontfaces;
+  std::shared_ptr<const SourceLineIndex> lineIndex;
 };
 
 class ParseException
 {
 public:
-  ParseException(const std::string& msg, const std::string& errorContext = "")
+  ParseException(const std::string& msg,
+                 const std::string& errorContext = "",
+                 int line = 0,
+                 int column = 0)
     : mMsg(msg)
     , mErrorContext(errorContext)
+    , mLine(line)
+    , mColumn(column)
   {
   }
 
@@ -90,16 +126,55 @@ class ParseException
   {
     return mErrorContext;
   }
+  /*! The 1-based line of the error or 0 if unknown */
+  int line() const
+  {
+    return mLine;
+  }
+  /*! The 0-based column of the error */
+  int column() const
+  {
+    return mColumn;
+  }
 
 private:
   std::string mMsg;
   std::string mErrorContext;
+  int mLine;
+  int mColumn;
+};
+
+/*! The available implementations of the style sheet parser */
+enum class ParserBackend {
+  kSpirit,          //!< the Boost.Spirit based grammar
+  kRecursiveDescent //!< the hand-written single pass parser
 };
 
+/*! Returns the parser backend used when none is passed explicitly
+ *
+ * The default is chosen at build time with the CMake variable
+ * STYLESHEETS_PARSER.  It can be overridden at runtime by setting the
+ * environment variable AQT_STYLESHEETS_PARSER to "spirit" or
+ * "recursive-descent".
+ */
+ParserBackend defaultParserBackend();
+
 StyleSheet parseStdString(const std::string& data);
+StyleSheet parseStdString(const std::string& data, ParserBackend backend);
+StyleSheet parseStdString(const std::string& data,
+                          ParserBackend backend,
+                          std::size_t maxThreads);
 StyleSheet parseString(const QString& path);
 
 /*! Read and parse the style sheet file from @path
+ *
+ * @p path can be a local file or a qrc resource path (":/...").  The file
+ * is read into one buffer, which is parsed in place; it is not mapped, since
+ * it may be rewritten while being parsed.  Large files are split at
+ * top level rules and the parts are parsed in parallel on up to
+ * @p maxThreads threads, which defaults to the number of cores.  If no
+ * more threads can be started the remaining parts are parsed on the
+ * calling thread.
  *
  * @return the parsed style sheet
  *
@@ -108,6 +183,24 @@ StyleSheet parseString(const QString& path);
  * @throw ParseException when the stylesheet could not be parsed
  */
 StyleSheet parseStyleFile(const QString& path);
+StyleSheet parseStyleFile(const QString& path, std::size_t maxThreads);
+
+namespace detail
+{
+
+/*! Splits [@p first, @p last) into at most @p maxChunks ranges of roughly
+ *  equal size, but at least @p minChunkSize bytes
+ *
+ * Ranges are only cut right after the closing brace of a top level rule,
+ * braces in strings and comments are skipped.  The returned positions
+ * include @p first and @p last.
+ */
+std::vector<const char*> splitAtRuleBoundaries(const char* first,
+                                               const char* last,
+                                               std::size_t maxChunks,
+                                               std::ptrdiff_t minChunkSize);
+
+} // namespace detail
 
 } // namespace stylesheets
 } // namespace aqt
@@ -0,0 +1,531 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "CssRecursiveParser.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace aqt
+{
+namespace stylesheets
+{
+namespace detail
+{
+namespace
+{
+
+bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+bool isXDigit(char c)
+{
+  return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool isAlnum(char c)
+{
+  return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool isIdentifierChar(char c)
+{
+  return isAlnum(c) || c == '-';
+}
+
+bool isNumberChar(char c)
+{
+  return isDigit(c) || c == '-' || c == '.';
+}
+
+/*! A single pass recursive descent parser for style sheets
+ *
+ * Each parse function mirrors the rule of the same name in the Spirit
+ * grammar (see StyleSheetGrammar in CssParser.cpp), including the ordered
+ * choice between alternatives.  Functions prefixed with "scan" don't skip
+ * leading whitespace, the others do.  All of them leave the read position
+ * untouched when they fail.
+ *
+ * Tokens are scanned as ranges over the source and copied into a string
+ * only once they are known to be part of the result.
+ */
+class Parser
+{
+public:
+  Parser(const char* source,
+         const char* first,
+         const char* last,
+         const SourceLineIndex& lineIndex)
+    : mSource(source)
+    , mLast(last)
+    , mPos(first)
+    , mLineIndex(lineIndex)
+  {
+  }
+
+  StyleSheet parseStyleSheet()
+  {
+    StyleSheet styleSheet;
+
+    for (;;) {
+      PropertySpecSet propset;
+      FontFaceDecl fontface;
+
+      if (parsePropset(propset)) {
+        styleSheet.propsets.emplace_back(std::move(propset));
+      } else if (parseFontFaceDecl(fontface)) {
+        styleSheet.fontfaces.emplace_back(std::move(fontface));
+      } else if (!parseComment()) {
+        break;
+      }
+    }
+
+    skipSpace();
+
+    if (mPos != mLast) {
+      throw makeParseException(
+        "Found unexpected tokens", mSource, mLast, mPos, mLineIndex);
+    }
+
+    return styleSheet;
+  }
+
+private:
+  void skipSpace()
+  {
+    while (mPos != mLast && isSpace(*mPos)) {
+      ++mPos;
+    }
+  }
+
+  bool scanChar(char c)
+  {
+    if (mPos != mLast && *mPos == c) {
+      ++mPos;
+      return true;
+    }
+    return false;
+  }
+
+  bool scanLiteral(const char* str)
+  {
+    const auto len = std::strlen(str);
+    if (size_t(mLast - mPos) >= len && std::equal(str, str + len, mPos)) {
+      mPos += len;
+      return true;
+    }
+    return false;
+  }
+
+  bool parseChar(char c)
+  {
+    const char* save = mPos;
+    skipSpace();
+    if (scanChar(c)) {
+      return true;
+    }
+    mPos = save;
+    return false;
+  }
+
+  bool parseLiteral(const char* str)
+  {
+    const char* save = mPos;
+    skipSpace();
+    if (scanLiteral(str)) {
+      return true;
+    }
+    mPos = save;
+    return false;
+  }
+
+  template <typename Pred>
+  const char* scanWhile(Pred pred)
+  {
+    const char* start = mPos;
+    while (mPos != mLast && pred(*mPos)) {
+      ++mPos;
+    }
+    return start;
+  }
+
+  // identifier := (alnum | '-')+
+  bool scanIdentifier(std::string& result)
+  {
+    const char* start = scanWhile(isIdentifierChar);
+    if (start == mPos) {
+      return false;
+    }
+    result.assign(start, mPos);
+    return true;
+  }
+
+  bool parseIdentifier(std::string& result)
+  {
+    const char* save = mPos;
+    skipSpace();
+    if (scanIdentifier(result)) {
+      return true;
+    }
+    mPos = save;
+    return false;
+  }
+
+  // comment := '//' (char - eol)* eol | '/*' (char - '*/')* '*/'
+  bool scanComment()
+  {
+    const char* start = mPos;
+
+    if (scanLiteral("//")) {
+      scanWhile([](char c) { return c != '\r' && c != '\n'; });
+      if (mPos != mLast) {
+        scanChar('\r');
+        scanChar('\n');
+        return true;
+      }
+    } else if (scanLiteral("/*")) {
+      const char* const kEnd = "*/";
+      const char* end = std::search(mPos, mLast, kEnd, kEnd + 2);
+      if (end != mLast) {
+        mPos = end + 2;
+        return true;
+      }
+    }
+
+    mPos = start;
+    return false;
+  }
+
+  bool parseComment()
+  {
+    const char* save = mPos;
+    skipSpace();
+    if (scanComment()) {
+      return true;
+    }
+    mPos = save;
+    return false;
+  }
+
+  // sel_part := ('.' identifier | ':' identifier | identifier)+
+  bool scanSelectorPart(SelectorParts& parts)
+  {
+    while (mPos != mLast) {
+      const char* start = mPos;
+      if (!scanChar('.')) {
+        scanChar(':');
+      }
+      const char* nameStart = scanWhile(isIdentifierChar);
+      if (nameStart == mPos) {
+        mPos = start;
+        break;
+      }
+      parts.emplace_back(start, mPos);
+    }
+
+    return !parts.empty();
+  }
+
+  // selector := (sel_part | '>')+
+  bool parseSelector(Selector& selector)
+  {
+    for (;;) {
+      const char* save = mPos;
+      skipSpace();
+
+      SelectorParts parts;
+      if (scanSelectorPart(parts)) {
+        selector.emplace_back(std::move(parts));
+      } else if (scanChar('>')) {
+        selector.emplace_back(SelectorParts{">"});
+      } else {
+        mPos = save;
+        break;
+      }
+    }
+
+    return !selector.empty();
+  }
+
+  // quoted_string := '"' (char - '"')+ '"' | '\'' (char - '\'')+ '\''
+  bool scanQuotedString(std::string& result)
+  {
+    if (mPos == mLast || (*mPos != '"' && *mPos != '\'')) {
+      return false;
+    }
+
+    const char* start = std::next(mPos);
+    const char* end = std::find(start, mLast, *mPos);
+    if (end == mLast || end == start) {
+      return false;
+    }
+
+    result.assign(start, end);
+    mPos = std::next(end);
+    return true;
+  }
+
+  // number := (digit | '-' | '.')+ '%'*
+  bool scanNumber(std::string& result)
+  {
+    const char* start = scanWhile(isNumberChar);
+    if (start == mPos) {
+      return false;
+    }
+    scanWhile([](char c) { return c == '%'; });
+    result.assign(start, mPos);
+    return true;
+  }
+
+  // color := '#' xdigit+
+  bool scanColor(std::string& result)
+  {
+    const char* start = mPos;
+    if (scanChar('#') && scanWhile(isXDigit) != mPos) {
+      result.assign(start, mPos);
+      return true;
+    }
+    mPos = start;
+    return false;
+  }
+
+  // atom_value := quoted_string | number | color | identifier
+  bool parseAtomValue(std::string& result)
+  {
+    const char* save = mPos;
+    skipSpace();
+    if (scanQuotedString(result) || scanNumber(result) || scanColor(result)
+        || scanIdentifier(result)) {
+      return true;
+    }
+    mPos = save;
+    return false;
+  }
+
+  // args := atom_value (',' > atom_value)*
+  bool parseArgs(std::vector<std::string>& args)
+  {
+    std::string arg;
+    if (!parseAtomValue(arg)) {
+      return false;
+    }
+    args.emplace_back(std::move(arg));
+
+    while (parseChar(',')) {
+      if (!parseAtomValue(arg)) {
+        skipSpace();
+        throw makeParseException(
+          "Expected atomic value", mSource, mLast, mPos, mLineIndex);
+      }
+      args.emplace_back(std::move(arg));
+    }
+
+    return true;
+  }
+
+  // expression := identifier '(' args* ')', with the identifier already read
+  bool parseExpressionArgs(Expression& expr)
+  {
+    const char* save = mPos;
+
+    if (parseChar('(')) {
+      std::vector<std::string> args;
+      while (parseArgs(args)) {
+        expr.args = std::move(args);
+        args.clear();
+      }
+
+      if (parseChar(')')) {
+        return true;
+      }
+    }
+
+    mPos = save;
+    return false;
+  }
+
+  // value := quoted_string | number | color | expression | identifier
+  bool parseValue(PropertyValue& value)
+  {
+    const char* save = mPos;
+    skipSpace();
+
+    std::string str;
+    if (scanQuotedString(str) || scanNumber(str) || scanColor(str)) {
+      value = std::move(str);
+      return true;
+    }
+
+    if (scanIdentifier(str)) {
+      Expression expr;
+      if (parseExpressionArgs(expr)) {
+        expr.name = std::move(str);
+        value = std::move(expr);
+      } else {
+        value = std::move(str);
+      }
+      return true;
+    }
+
+    mPos = save;
+    return false;
+  }
+
+  // values := value (',' > value)*
+  bool parseValues(PropertyValues& values)
+  {
+    PropertyValue value;
+    if (!parseValue(value)) {
+      return false;
+    }
+    values.emplace_back(std::move(value));
+
+    while (parseChar(',')) {
+      if (!parseValue(value)) {
+        skipSpace();
+        throw makeParseException("Expected value", mSource, mLast, mPos, mLineIndex);
+      }
+      values.emplace_back(std::move(value));
+    }
+
+    return true;
+  }
+
+  // value_pair := identifier ':' values ';'?
+  bool parseValuePair(PropertySpec& spec)
+  {
+    const char* save = mPos;
+    skipSpace();
+    spec.mSourceLoc.mByteOfs = static_cast<int>(mPos - mSource);
+
+    if (scanIdentifier(spec.name) && parseChar(':') && parseValues(spec.values)) {
+      parseChar(';');
+      return true;
+    }
+
+    mPos = save;
+    return false;
+  }
+
+  // propset := selector (',' selector | comment)* '{' (value_pair | comment)* '}'
+  bool parsePropset(PropertySpecSet& propset)
+  {
+    const char* save = mPos;
+    skipSpace();
+    propset.mSourceLoc.mByteOfs = static_cast<int>(mPos - mSource);
+
+    Selector selector;
+    if (parseSelector(selector)) {
+      propset.selectors.emplace_back(std::move(selector));
+
+      for (;;) {
+        const char* loopSave = mPos;
+        Selector nextSelector;
+        if (parseChar(',') && parseSelector(nextSelector)) {
+          propset.selectors.emplace_back(std::move(nextSelector));
+        } else {
+          mPos = loopSave;
+          if (!parseComment()) {
+            break;
+          }
+        }
+      }
+
+      if (parseChar('{')) {
+        for (;;) {
+          PropertySpec spec;
+          if (parseValuePair(spec)) {
+            propset.properties.emplace_back(std::move(spec));
+          } else if (!parseComment()) {
+            break;
+          }
+        }
+
+        if (parseChar('}')) {
+          return true;
+        }
+      }
+    }
+
+    mPos = save;
+    return false;
+  }
+
+  // fontfacedecl := '@font-face' comment? '{' comment? 'src' ':' comment?
+  //                 'url' '(' (identifier | quoted_string) ')' ';'? comment? '}'
+  bool parseFontFaceDecl(FontFaceDecl& fontface)
+  {
+    const char* save = mPos;
+
+    if (parseLiteral("@font-face")) {
+      parseComment();
+      if (parseChar('{')) {
+        parseComment();
+        if (parseLiteral("src") && parseChar(':')) {
+          parseComment();
+          if (parseLiteral("url") && parseChar('(')) {
+            skipSpace();
+            if ((scanIdentifier(fontface.url) || scanQuotedString(fontface.url))
+                && parseChar(')')) {
+              parseChar(';');
+              parseComment();
+              if (parseChar('}')) {
+                return true;
+              }
+            }
+          }
+        }
+      }
+    }
+
+    mPos = save;
+    return false;
+  }
+
+  const char* const mSource;
+  const char* const mLast;
+  const char* mPos;
+  const SourceLineIndex& mLineIndex;
+};
+
+} // anon namespace
+
+StyleSheet parseRecursiveDescent(const char* source,
+                                 const char* first,
+                                 const char* last,
+                                 const SourceLineIndex& lineIndex)
+{
+  return Parser(source, first, last, lineIndex).parseStyleSheet();
+}
+
+} // namespace detail
+} // namespace stylesheets
+} // namespace aqt
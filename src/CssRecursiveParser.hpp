@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CssParser.hpp"
+
+#include <string>
+
+/*! @cond DOXYGEN_IGNORE */
+
+namespace aqt
+{
+namespace stylesheets
+{
+namespace detail
+{
+
+/*! Parse the style sheet in [@p first, @p last) with the recursive descent
+ *  parser
+ *
+ * The accepted language and the resulting StyleSheet are identical to the
+ * ones of the Boost.Spirit grammar in CssParser.cpp.  The range can be a
+ * part of a larger source starting at @p source, which source locations and
+ * error positions are relative to.
+ *
+ * @throw ParseException when the stylesheet could not be parsed
+ */
+StyleSheet parseRecursiveDescent(const char* source,
+                                 const char* first,
+                                 const char* last,
+                                 const SourceLineIndex& lineIndex);
+
+/*! Create the ParseException for an error found at @p errorPos */
+ParseException makeParseException(const std::string& msg,
+                                  const char* first,
+                                  const char* last,
+                                  const char* errorPos,
+                                  const SourceLineIndex& lineIndex);
+
+} // namespace detail
+} // namespace stylesheets
+} // namespace aqt
+
+/*! @endcond */
@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "MappedFile.hpp"
+
+#include <ios>
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+MappedFile::MappedFile(const QString& path)
+  : mFile(path)
+  , mFirst(nullptr)
+  , mLast(nullptr)
+{
+  if (!mFile.open(QIODevice::ReadOnly)) {
+    throw std::ios_base::failure("Could not open '" + path.toStdString() + "'");
+  }
+
+  const auto size = mFile.size();
+  if (size > 0) {
+    if (const uchar* pData = mFile.map(0, size)) {
+      mFirst = reinterpret_cast<const char*>(pData);
+      mLast = mFirst + size;
+    } else {
+      mBuffer = mFile.readAll();
+      if (mFile.error() != QFileDevice::NoError) {
+        throw std::ios_base::failure("Could not read '" + path.toStdString() + "'");
+      }
+      mFirst = mBuffer.constData();
+      mLast = mFirst + mBuffer.size();
+    }
+  }
+}
+
+} // namespace stylesheets
+} // namespace aqt
@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+RESTORE_WARNINGS
+
+/*! @cond DOXYGEN_IGNORE */
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+/*! Provides the content of a file as a range of characters
+ *
+ * The file is mapped into memory, which works for local files and
+ * uncompressed qrc resources alike.  If mapping is not possible (e.g. for
+ * compressed resources) the content is read into a buffer instead.
+ *
+ * Accessing a mapped local file after it has been truncated raises SIGBUS,
+ * so files which may be rewritten in place while in use must not be mapped.
+ */
+class MappedFile
+{
+public:
+  /*! @throw std::ios_base::failure for IO errors or if the file at @p path
+   *         could not be opened. */
+  explicit MappedFile(const QString& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* begin() const
+  {
+    return mFirst;
+  }
+
+  const char* end() const
+  {
+    return mLast;
+  }
+
+private:
+  QFile mFile;
+  QByteArray mBuffer;
+  const char* mFirst;
+  const char* mLast;
+};
+
+} // namespace stylesheets
+} // namespace aqt
+
+/*! @endcond */
@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "PathNode.hpp"
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <boost/functional/hash.hpp>
+RESTORE_WARNINGS
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+namespace
+{
+
+class PathTable
+{
+public:
+  const PathNode* intern(const PathNode* pParent, const PathElement& element)
+  {
+    auto hash = pParent ? pParent->hash() : 0;
+    boost::hash_combine(hash, hash_value(element));
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // nodes are found by their hash, so looking up an interned path does
+    // not need to copy its element
+    auto& candidates = mNodesByHash[hash];
+    const auto it = std::find_if(candidates.begin(), candidates.end(),
+                                 [&](const PathNode* pNode) {
+                                   return pNode->parent() == pParent
+                                          && pNode->element() == element;
+                                 });
+    if (it != candidates.end()) {
+      return *it;
+    }
+
+    mNodes.emplace_back(pParent, element, hash);
+    candidates.push_back(&mNodes.back());
+    return &mNodes.back();
+  }
+
+  std::size_t size()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mNodes.size();
+  }
+
+private:
+  std::mutex mMutex;
+  std::unordered_map<std::size_t, std::vector<const PathNode*>> mNodesByHash;
+  // a deque never moves its elements, which keeps the nodes' addresses valid
+  std::deque<PathNode> mNodes;
+};
+
+PathTable& pathTable()
+{
+  static PathTable sPathTable;
+  return sPathTable;
+}
+
+} // anon namespace
+
+UiItemPath PathNode::path() const
+{
+  UiItemPath result(mDepth, PathElement(mElement.mTypeName));
+  auto i = mDepth;
+  for (const auto* pNode = this; pNode; pNode = pNode->parent()) {
+    result[--i] = pNode->element();
+  }
+  return result;
+}
+
+const PathNode* internPath(const PathNode* pParent, const PathElement& element)
+{
+  return pathTable().intern(pParent, element);
+}
+
+const PathNode* internPath(const UiItemPath& path)
+{
+  const PathNode* pNode = nullptr;
+  for (const auto& element : path) {
+    pNode = internPath(pNode, element);
+  }
+  return pNode;
+}
+
+std::size_t internedPathCount()
+{
+  return pathTable().size();
+}
+
+UiItemPath pathElements(const PathNode* pPath)
+{
+  return pPath ? pPath->path() : UiItemPath();
+}
+
+std::string pathToString(const PathNode* pPath)
+{
+  return pathToString(pathElements(pPath));
+}
+
+} // namespace stylesheets
+} // namespace aqt
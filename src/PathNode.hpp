@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "StyleMatchTree.hpp"
+
+#include <cstddef>
+#include <string>
+
+/*! @cond DOXYGEN_IGNORE */
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+/*! An interned item path
+ *
+ * Paths are interned in a process wide prefix tree: a node holds the last
+ * element of a path and refers to the node of its parent path, the empty
+ * path being represented by @c nullptr.  Equal paths are always the same
+ * node, so paths compare and hash by pointer and the parent path is a
+ * pointer away.  Like atoms, nodes are never released, since any cache
+ * keyed by a path may still refer to them.  The table thus holds one node
+ * for each distinct path (and prefix) seen by the process.  It doesn't grow
+ * with the number of items though, as recreating items with the same path
+ * reuses its node.
+ */
+class PathNode
+{
+public:
+  PathNode(const PathNode* pParent, PathElement element, std::size_t hash)
+    : mpParent(pParent)
+    , mElement(std::move(element))
+    , mHash(hash)
+    , mDepth(pParent ? pParent->depth() + 1 : 1)
+  {
+  }
+
+  PathNode(const PathNode&) = delete;
+  PathNode& operator=(const PathNode&) = delete;
+
+  //! Returns the node of the parent path or nullptr for the empty path
+  const PathNode* parent() const
+  {
+    return mpParent;
+  }
+
+  //! Returns the last element of the path
+  const PathElement& element() const
+  {
+    return mElement;
+  }
+
+  //! Returns a hash over all elements of the path
+  std::size_t hash() const
+  {
+    return mHash;
+  }
+
+  //! Returns the number of elements of the path
+  std::size_t depth() const
+  {
+    return mDepth;
+  }
+
+  //! Returns the elements of the path
+  UiItemPath path() const;
+
+private:
+  const PathNode* mpParent;
+  PathElement mElement;
+  std::size_t mHash;
+  std::size_t mDepth;
+};
+
+/*! Returns the node of the path @p pParent extended by @p element
+ *
+ * This function is thread safe. */
+const PathNode* internPath(const PathNode* pParent, const PathElement& element);
+
+/*! Returns the node of @p path or nullptr if @p path is empty
+ *
+ * This function is thread safe. */
+const PathNode* internPath(const UiItemPath& path);
+
+//! Returns the number of paths interned so far
+std::size_t internedPathCount();
+
+//! Returns the elements of @p pPath; an empty path for nullptr
+UiItemPath pathElements(const PathNode* pPath);
+std::string pathToString(const PathNode* pPath);
+
+} // namespace stylesheets
+} // namespace aqt
+
+/*! @endcond */
@@ -46,25 +46,36 @@ class Expression
   std::vector<std::string> args;
 };
 
+inline bool operator==(const Expression& lhs, const Expression& rhs)
+{
+  return lhs.name == rhs.name && lhs.args == rhs.args;
+}
+
+inline bool operator!=(const Expression& lhs, const Expression& rhs)
+{
+  return !(lhs == rhs);
+}
+
 using PropertyValue = boost::variant<std::string, Expression>;
 using PropertyValues = std::vector<PropertyValue>;
 
+/*! The location of a rule or property in its style sheet source
+ *
+ * Only the byte offset is tracked while parsing.  Line and column numbers
+ * are resolved on demand through the style sheet's SourceLineIndex.
+ */
 class SourceLocation
 {
 public:
   SourceLocation()
     : mSourceLayer(0)
     , mByteOfs(0)
-    , mLine(0)
-    , mColumn(0)
   {
   }
 
-  SourceLocation(int sourceLayer, int byteOfs, int line, int column)
+  SourceLocation(int sourceLayer, int byteOfs)
     : mSourceLayer(sourceLayer)
     , mByteOfs(byteOfs)
-    , mLine(line)
-    , mColumn(column)
   {
   }
 
@@ -76,8 +87,6 @@ class SourceLocation
 
   int mSourceLayer;
   int mByteOfs;
-  int mLine;
-  int mColumn;
 };
 
 class Property
@@ -0,0 +1,188 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "CssParser.hpp"
+#include "StyleMatchTree.hpp"
+#include "StyleSheetImage.hpp"
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <QtCore/QSaveFile>
+#include <QtCore/QString>
+RESTORE_WARNINGS
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <ios>
+#include <sstream>
+#include <string>
+
+/*! aqt-stylec -- compiles style sheets into the precompiled binary format
+ *
+ * @code
+ * aqt-stylec [-o <output>] [--cpp <symbol>] <input.css>
+ * @endcode
+ *
+ * Without options <input.css> is compiled into <input.css>.bin, which the
+ * StyleEngine picks up instead of the style sheet itself.  With --cpp the
+ * image is written as C++ source file defining the constant char array
+ * <symbol> (and its size <symbol>_size) instead, which can be linked into
+ * the application and loaded with StyleSheetImage::fromStaticData().  The
+ * image is in the byte order of the machine running aqt-stylec, so the
+ * source only builds for targets of the same byte order.
+ *
+ * The output is replaced by renaming a new file over it, so applications
+ * which map the previous image keep a valid mapping.
+ *
+ * Parse errors are reported in the compiler's error format and make the
+ * tool fail.
+ */
+
+namespace
+{
+
+using namespace aqt::stylesheets;
+
+void printUsage()
+{
+  std::cerr << "usage: aqt-stylec [-o <output>] [--cpp <symbol>] <input.css>"
+            << std::endl;
+}
+
+void writeBinary(std::ostream& os, const StyleSheetImage& image)
+{
+  os.write(image.data(), std::streamsize(image.size()));
+}
+
+//! Returns whether this machine, which determines the image's byte order, is
+//! little endian
+bool isLittleEndian()
+{
+  const std::uint32_t word = 1;
+  char firstByte = 0;
+  std::memcpy(&firstByte, &word, 1);
+  return firstByte == 1;
+}
+
+void writeCpp(std::ostream& os,
+              const StyleSheetImage& image,
+              const std::string& symbol,
+              const std::string& inputPath)
+{
+  // The image is emitted byte by byte, so that the table holds exactly the
+  // same bytes on any target.  Its numbers are in the byte order of this
+  // machine though, so building it for a target of the other order fails
+  // where the compiler tells the order, and fromStaticData() rejects it
+  // otherwise.
+  const auto byteOrder = isLittleEndian() ? "__ORDER_LITTLE_ENDIAN__"
+                                          : "__ORDER_BIG_ENDIAN__";
+
+  os << "// Generated by aqt-stylec from " << inputPath << ".  Do not edit.\n"
+     << "\n"
+     << "#include <cstddef>\n"
+     << "\n"
+     << "#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != " << byteOrder << "\n"
+     << "#error \"" << symbol << " has been compiled for another byte order\"\n"
+     << "#endif\n"
+     << "\n"
+     << "extern const char " << symbol << "[];\n"
+     << "extern const std::size_t " << symbol << "_size;\n"
+     << "\n"
+     << "// aligned to be used in place\n"
+     << "alignas(4) const char " << symbol << "[] = {";
+
+  const auto* pData = reinterpret_cast<const unsigned char*>(image.data());
+  for (std::size_t i = 0; i < image.size(); ++i) {
+    os << (i % 10 == 0 ? "\n  " : " ") << "'\\x" << std::hex << std::setw(2)
+       << std::setfill('0') << unsigned(pData[i]) << std::dec << "',";
+  }
+
+  os << "\n};\n"
+     << "\n"
+     << "const std::size_t " << symbol << "_size = " << image.size() << ";\n";
+}
+
+} // anon namespace
+
+int main(int argc, char** argv)
+{
+  std::string inputPath;
+  std::string outputPath;
+  std::string symbol;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if ((arg == "-o" || arg == "--cpp") && i + 1 < argc) {
+      (arg == "-o" ? outputPath : symbol) = argv[++i];
+    } else if (arg.empty() || arg[0] == '-' || !inputPath.empty()) {
+      printUsage();
+      return 2;
+    } else {
+      inputPath = arg;
+    }
+  }
+
+  if (inputPath.empty()) {
+    printUsage();
+    return 2;
+  }
+
+  if (outputPath.empty()) {
+    outputPath = inputPath + (symbol.empty() ? ".bin" : ".cpp");
+  }
+
+  try {
+    const auto pImage =
+      compileStyleSheet(parseStyleFile(QString::fromStdString(inputPath)));
+
+    std::ostringstream out;
+    if (symbol.empty()) {
+      writeBinary(out, *pImage);
+    } else {
+      writeCpp(out, *pImage, symbol, inputPath);
+    }
+
+    // A running StyleEngine maps the image file, which must thus not be
+    // truncated.  QSaveFile writes a temporary file next to it and renames
+    // it over the output.
+    const auto content = out.str();
+    QSaveFile file(QString::fromStdString(outputPath));
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(content.data(), qint64(content.size())) != qint64(content.size())
+        || !file.commit()) {
+      std::cerr << outputPath << ": error: could not write file" << std::endl;
+      return 1;
+    }
+  } catch (const ParseException& e) {
+    std::cerr << inputPath << ":" << e.line() << ":" << e.column()
+              << ": error: " << e.message() << ": " << e.errorContext() << std::endl;
+    return 1;
+  } catch (const std::ios_base::failure& fail) {
+    std::cerr << inputPath << ": error: " << fail.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -23,16 +23,20 @@ THE SOFTWARE.
 #include "StyleEngine.hpp"
 
 #include "estd/memory.hpp"
+#include "Atom.hpp"
 #include "CssParser.hpp"
 #include "Log.hpp"
 #include "StyleMatchTree.hpp"
 #include "StyleSetProps.hpp"
+#include "StyleSheetImage.hpp"
 #include "UrlUtils.hpp"
 #include "Warnings.hpp"
 
 SUPPRESS_WARNINGS
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QPointer>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QDir>
 #include <QtCore/QUrl>
 #include <QtGui/QFontDatabase>
@@ -41,9 +45,14 @@ SUPPRESS_WARNINGS
 #include <QtQml/qqml.h>
 RESTORE_WARNINGS
 
+#include <algorithm>
+#include <future>
 #include <iostream>
 #include <iterator>
+#include <system_error>
+#include <thread>
 #include <tuple>
+#include <utility>
 
 namespace aqt
 {
@@ -53,6 +62,11 @@ namespace stylesheets
 namespace
 {
 
+const QLatin1String kCompiledStyleSheetSuffix(".bin");
+
+//! The number of unused StyleSetProps kept for reuse
+const std::size_t kMaxUnusedStyleSetProps = 256;
+
 QPointer<StyleEngine>& globalStyleEngineImpl()
 {
   static QPointer<StyleEngine> sGlobalStyleEngine;
@@ -68,8 +82,125 @@ void setGlobalStyleEngine(StyleEngine* pEngine)
   }
 }
 
+//! Returns a hash over the content of a style sheet and its compiled image
+QByteArray styleSheetHash(const QString& styleFilePath)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  const QString filePaths[] = {styleFilePath, styleFilePath + kCompiledStyleSheetSuffix};
+  for (const auto& filePath : filePaths) {
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly)) {
+      hash.addData(&file);
+    }
+  }
+
+  return hash.result();
+}
+
+std::shared_ptr<const StyleSheetImage> loadStyleSheetImage(const QString& styleFilePath,
+                                                           std::size_t maxThreads)
+{
+  if (styleFilePath.endsWith(kCompiledStyleSheetSuffix)) {
+    return StyleSheetImage::load(styleFilePath);
+  }
+
+  const QFileInfo compiledInfo(styleFilePath + kCompiledStyleSheetSuffix);
+  if (compiledInfo.exists()
+      && (!QFile::exists(styleFilePath)
+          || QFileInfo(styleFilePath).lastModified() <= compiledInfo.lastModified())) {
+    try {
+      return StyleSheetImage::load(compiledInfo.filePath());
+    } catch (const ParseException& e) {
+      styleSheetsLogWarning() << "Ignoring '" << compiledInfo.filePath().toStdString()
+                              << "': " << e.message();
+    }
+  }
+
+  return compileStyleSheet(parseStyleFile(styleFilePath, maxThreads));
+}
+
 } // anon namespace
 
+/*! Loads the style sheets and builds a StyleSnapshot of them
+ *
+ * run() only touches the job itself and can thus be executed on a worker
+ * thread.  Exceptions to report are collected for the GUI thread.  Style
+ * sheets which are passed in loaded already are reused if their files didn't
+ * change. */
+class StyleEngine::LoadJob
+{
+public:
+  //! the type and message of exceptions to report
+  using Exceptions = std::vector<std::pair<QString, QString>>;
+
+  LoadJob(LoadedStyleSheet styleSheet,
+          LoadedStyleSheet defaultStyleSheet,
+          std::vector<const PathNode*> paths,
+          unsigned int generation)
+    : mStyleSheet(std::move(styleSheet))
+    , mDefaultStyleSheet(std::move(defaultStyleSheet))
+    , mPaths(std::move(paths))
+    , mGeneration(generation)
+  {
+  }
+
+  void run()
+  {
+    const auto pOldStyleSheet = mStyleSheet.mpImage;
+    const auto pOldDefaultStyleSheet = mDefaultStyleSheet.mpImage;
+
+    // the default style sheet is loaded alongside the user's one, so each of
+    // them gets half of the threads for parsing
+    const auto maxThreads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+    auto defaultExceptions = Exceptions{};
+    std::future<void> defaultStyleSheet;
+    try {
+      defaultStyleSheet = std::async(std::launch::async, [&] {
+        loadStyleSheet(mDefaultStyleSheet, defaultExceptions, maxThreads);
+      });
+    } catch (const std::system_error& e) {
+      styleSheetsLogWarning() << "Loading the default style sheet sequentially: "
+                              << e.what();
+    }
+
+    loadStyleSheet(mStyleSheet, mExceptions, maxThreads);
+    if (defaultStyleSheet.valid()) {
+      defaultStyleSheet.get();
+    } else {
+      loadStyleSheet(mDefaultStyleSheet, defaultExceptions, maxThreads);
+    }
+
+    std::move(defaultExceptions.begin(), defaultExceptions.end(),
+              std::back_inserter(mExceptions));
+
+    if (mStyleSheet.mpImage == pOldStyleSheet
+        && mDefaultStyleSheet.mpImage == pOldDefaultStyleSheet) {
+      return;
+    }
+
+    mpSnapshot = std::make_shared<StyleSnapshot>(
+      createMatchTree(mStyleSheet.mpImage, mDefaultStyleSheet.mpImage), mGeneration);
+
+    // resolve the paths in use now rather than on the GUI thread later
+    mpSnapshot->prewarm(mPaths);
+  }
+
+  LoadedStyleSheet mStyleSheet;
+  LoadedStyleSheet mDefaultStyleSheet;
+  std::vector<const PathNode*> mPaths;
+  unsigned int mGeneration;
+
+  //! the new styles or nullptr if neither style sheet changed
+  std::shared_ptr<StyleSnapshot> mpSnapshot;
+  Exceptions mExceptions;
+
+private:
+  static void loadStyleSheet(LoadedStyleSheet& styleSheet,
+                             Exceptions& exceptions,
+                             std::size_t maxThreads);
+};
+
 StyleEngineHost* StyleEngineHost::globalStyleEngineHost()
 {
   static StyleEngineHost gGlobalStyleEngineHost;
@@ -89,12 +220,20 @@ StyleEngineHost::FontIdCache& StyleEngineHost::fontIdCache()
 
 StyleEngine::StyleEngine(QObject* pParent)
   : QObject(pParent)
+  , mpSnapshot(std::make_shared<StyleSnapshot>(createMatchTree(nullptr, nullptr), 0))
   , mFontIdCache(StyleEngineHost::globalStyleEngineHost()->fontIdCache())
   , mStylesDir(this)
+  , mLazyReload(false)
+  , mAsyncLoading(false)
+  , mIsReloadPending(false)
 {
   connect(
     &mFsWatcher, &QFileSystemWatcher::fileChanged, this, &StyleEngine::onFileChanged);
 
+  mReloadTimer.setSingleShot(true);
+  mReloadTimer.setInterval(100);
+  connect(&mReloadTimer, &QTimer::timeout, this, &StyleEngine::onReloadTimeout);
+
   connect(&mStylesDir, &StylesDirWatcher::availableStylesChanged, this,
           &StyleEngine::availableStylesChanged);
   connect(&mStylesDir, &StylesDirWatcher::fileExtensionsChanged, this,
@@ -103,9 +242,12 @@ StyleEngine::StyleEngine(QObject* pParent)
 
 StyleEngine::~StyleEngine()
 {
+  if (mLoadThread.joinable()) {
+    mLoadThread.join();
+  }
+
   for (auto& element : mStyleSetPropsByPath) {
-    auto& pStyleSetProps = element.second;
-    Q_EMIT pStyleSetProps->invalidated();
+    Q_EMIT element.second.mpStyleSetProps->invalidated();
   }
 }
 
@@ -141,6 +283,45 @@ void StyleEngine::setDefaultStyleSheetSource(const QUrl& url)
   }
 }
 
+bool StyleEngine::lazyReload() const
+{
+  return mLazyReload;
+}
+
+void StyleEngine::setLazyReload(bool isLazy)
+{
+  if (mLazyReload != isLazy) {
+    mLazyReload = isLazy;
+    Q_EMIT lazyReloadChanged();
+  }
+}
+
+bool StyleEngine::asyncLoading() const
+{
+  return mAsyncLoading;
+}
+
+void StyleEngine::setAsyncLoading(bool isAsync)
+{
+  if (mAsyncLoading != isAsync) {
+    mAsyncLoading = isAsync;
+    Q_EMIT asyncLoadingChanged();
+  }
+}
+
+int StyleEngine::reloadDelay() const
+{
+  return mReloadTimer.interval();
+}
+
+void StyleEngine::setReloadDelay(int msecs)
+{
+  if (mReloadTimer.interval() != msecs) {
+    mReloadTimer.setInterval(msecs);
+    Q_EMIT reloadDelayChanged();
+  }
+}
+
 QUrl StyleEngine::stylePath() const
 {
   return mStylePathUrl;
@@ -223,25 +404,39 @@ QVariantList StyleEngine::availableStyles()
   return mStylesDir.availableStyleSheetNames();
 }
 
-std::string StyleEngine::describeMatchedPath(const UiItemPath& path) const
+std::string StyleEngine::describeMatchedPath(const PathNode* pPath) const
+{
+  return aqt::stylesheets::describeMatchedPath(mpSnapshot->tree(), pathElements(pPath));
+}
+
+void StyleEngine::onFileChanged(const QString& path)
 {
-  return aqt::stylesheets::describeMatchedPath(mpStyleTree.get(), path);
+  // files replaced by renaming are dropped from the watcher
+  if (!mFsWatcher.files().contains(path) && QFile::exists(path)) {
+    mFsWatcher.addPath(path);
+  }
+
+  mReloadTimer.start();
 }
 
-void StyleEngine::onFileChanged(const QString&)
+void StyleEngine::onReloadTimeout()
 {
+  // a file which was about to be replaced when it changed exists again now
+  mStyleSheetSourceUrl.rewatch(this, mFsWatcher);
+  mDefaultStyleSheetSourceUrl.rewatch(this, mFsWatcher);
+
   loadStyle();
 }
 
-void StyleEngine::resolveFontFaceDecl(const StyleSheet& styleSheet)
+void StyleEngine::resolveFontFaceDecl(const StyleSheetImage& styleSheet)
 {
-  for (auto ffd : styleSheet.fontfaces) {
-    QUrl fontFaceUrl = resolveResourceUrl(
-      mStyleSheetSourceUrl.url(), QUrl(QString::fromStdString(ffd.url)));
+  for (const auto& url : styleSheet.fontFaceUrls()) {
+    QUrl fontFaceUrl =
+      resolveResourceUrl(mStyleSheetSourceUrl.url(), QUrl(QString::fromStdString(url)));
     QString fontFaceFile = QQmlFile::urlToLocalFileOrQrc(fontFaceUrl);
 
     if (!fontFaceFile.isEmpty()) {
-      styleSheetsLogInfo() << "Load font face " << ffd.url << " from "
+      styleSheetsLogInfo() << "Load font face " << url << " from "
                            << fontFaceFile.toStdString();
       std::map<QString, int>::iterator fontCacheIt = mFontIdCache.find(fontFaceFile);
       if (fontCacheIt == mFontIdCache.end()) {
@@ -269,75 +464,184 @@ void StyleEngine::resolveFontFaceDecl(const StyleSheet& styleSheet)
   }
 }
 
-StyleSheet StyleEngine::loadStyleSheet(const SourceUrl& srcurl)
+QString StyleEngine::styleSheetFilePath(const SourceUrl& srcurl)
 {
-  if (srcurl.url().isLocalFile() || srcurl.url().isRelative()) {
-    QString styleFilePath = srcurl.toLocalFile(this);
+  if (srcurl.isEmpty()) {
+    return QString();
+  }
 
-    if (styleFilePath.isEmpty() || !QFile::exists(styleFilePath)) {
+  if (srcurl.url().isLocalFile() || srcurl.url().isRelative()
+      || srcurl.url().scheme() == QLatin1String("qrc")) {
+    QString styleFilePath = srcurl.toLocalFileOrQrc(this);
+
+    if (styleFilePath.isEmpty()
+        || (!QFile::exists(styleFilePath)
+            && !QFile::exists(styleFilePath + kCompiledStyleSheetSuffix))) {
       styleSheetsLogError() << "Style '" << styleFilePath.toStdString() << "' not found";
 
       Q_EMIT exception(QString::fromLatin1("styleSheetNotFound"),
                        QString::fromLatin1("Style '%1' not found.").arg(styleFilePath));
     } else {
-      styleSheetsLogInfo() << "Load style from '" << styleFilePath.toStdString()
-                           << "' ...";
+      return styleFilePath;
+    }
+  }
+
+  return QString();
+}
 
-      try {
-        StyleSheet styleSheet = parseStyleFile(styleFilePath);
+void StyleEngine::LoadJob::loadStyleSheet(LoadedStyleSheet& styleSheet,
+                                          Exceptions& exceptions,
+                                          std::size_t maxThreads)
+{
+  const auto& styleFilePath = styleSheet.mFilePath;
+  if (styleFilePath.isEmpty()) {
+    styleSheet.mpImage = nullptr;
+    return;
+  }
+
+  const auto hash = styleSheetHash(styleFilePath);
+  if (styleSheet.mpImage && hash == styleSheet.mHash) {
+    styleSheetsLogInfo() << "Style '" << styleFilePath.toStdString() << "' is unchanged";
+    return;
+  }
 
-        resolveFontFaceDecl(styleSheet);
+  styleSheetsLogInfo() << "Load style from '" << styleFilePath.toStdString() << "' ...";
 
-        return styleSheet;
-      } catch (const ParseException& e) {
-        styleSheetsLogError() << e.message() << ": " << e.errorContext();
+  styleSheet.mHash = hash;
+  styleSheet.mpImage = nullptr;
 
-        Q_EMIT exception(QString::fromLatin1("parsingStyleSheetfailed"),
-                         QString::fromLatin1("Parsing style sheet failed '%1'.")
-                           .arg(QString::fromStdString(e.message())));
-      } catch (const std::ios_base::failure& fail) {
-        styleSheetsLogError() << "loading style sheet failed: " << fail.what();
+  try {
+    styleSheet.mpImage = loadStyleSheetImage(styleFilePath, maxThreads);
+  } catch (const ParseException& e) {
+    styleSheetsLogError() << e.message() << " at line " << e.line() << " column "
+                          << e.column() << ": " << e.errorContext();
 
-        Q_EMIT exception(QString::fromLatin1("loadingStyleSheetFailed"),
-                         QString::fromLatin1("Loading style sheet failed '%1'.")
-                           .arg(QString::fromStdString(fail.what())));
+    exceptions.emplace_back(QString::fromLatin1("parsingStyleSheetfailed"),
+                            QString::fromLatin1("Parsing style sheet failed '%1'.")
+                              .arg(QString::fromStdString(e.message())));
+  } catch (const std::ios_base::failure& fail) {
+    styleSheetsLogError() << "loading style sheet failed: " << fail.what();
+
+    exceptions.emplace_back(QString::fromLatin1("loadingStyleSheetFailed"),
+                            QString::fromLatin1("Loading style sheet failed '%1'.")
+                              .arg(QString::fromStdString(fail.what())));
+  }
+}
+
+void StyleEngine::loadStyle()
+{
+  if (mLoadThread.joinable()) {
+    // load again once the running job is done, its result is outdated
+    mIsReloadPending = true;
+    return;
+  }
+
+  // the paths in use are resolved along with the new tree, unless they are
+  // resolved lazily anyway
+  std::vector<const PathNode*> paths;
+  if (!mLazyReload) {
+    for (const auto& element : mStyleSetPropsByPath) {
+      if (element.second.mUseCount > 0) {
+        paths.push_back(element.first);
       }
     }
   }
 
-  return StyleSheet();
+  // style sheets still loaded from the same file are reused if it didn't change
+  auto styleSheetToLoad = [this](const SourceUrl& srcurl,
+                                 const LoadedStyleSheet& loaded) -> LoadedStyleSheet {
+    auto styleSheet = LoadedStyleSheet{styleSheetFilePath(srcurl), QByteArray(), nullptr};
+    return styleSheet.mFilePath == loaded.mFilePath ? loaded : styleSheet;
+  };
+
+  auto pJob =
+    estd::make_unique<LoadJob>(styleSheetToLoad(mStyleSheetSourceUrl, mStyleSheet),
+                               styleSheetToLoad(mDefaultStyleSheetSourceUrl,
+                                                mDefaultStyleSheet),
+                               std::move(paths), mpSnapshot->generation() + 1);
+
+  if (mAsyncLoading) {
+    auto* pLoadJob = pJob.get();
+    try {
+      mLoadThread = std::thread([this, pLoadJob] {
+        pLoadJob->run();
+        // the engine joins the thread before it is destroyed, and pending
+        // invocations are dropped with it
+        QMetaObject::invokeMethod(this, "onStyleLoaded", Qt::QueuedConnection);
+      });
+      mpLoadJob = std::move(pJob);
+      return;
+    } catch (const std::system_error& e) {
+      styleSheetsLogWarning() << "Loading style sheets on the GUI thread: " << e.what();
+    }
+  }
+
+  pJob->run();
+  finishLoading(*pJob);
 }
 
-void StyleEngine::loadStyle()
+void StyleEngine::onStyleLoaded()
 {
-  StyleSheet styleSheet;
-  StyleSheet defaultStyleSheet;
+  mLoadThread.join();
+  auto pJob = std::move(mpLoadJob);
+
+  if (mIsReloadPending) {
+    mIsReloadPending = false;
+    loadStyle();
+  } else {
+    finishLoading(*pJob);
+  }
+}
 
-  if (!mStyleSheetSourceUrl.isEmpty()) {
-    styleSheet = loadStyleSheet(mStyleSheetSourceUrl);
+void StyleEngine::finishLoading(LoadJob& job)
+{
+  for (const auto& exc : job.mExceptions) {
+    Q_EMIT exception(exc.first, exc.second);
   }
 
-  if (!mDefaultStyleSheetSourceUrl.isEmpty()) {
-    defaultStyleSheet = loadStyleSheet(mDefaultStyleSheetSourceUrl);
+  if (job.mStyleSheet.mpImage && job.mStyleSheet.mpImage != mStyleSheet.mpImage) {
+    resolveFontFaceDecl(*job.mStyleSheet.mpImage);
   }
+  if (job.mDefaultStyleSheet.mpImage
+      && job.mDefaultStyleSheet.mpImage != mDefaultStyleSheet.mpImage) {
+    resolveFontFaceDecl(*job.mDefaultStyleSheet.mpImage);
+  }
+
+  mStyleSheet = std::move(job.mStyleSheet);
+  mDefaultStyleSheet = std::move(job.mDefaultStyleSheet);
 
-  mpStyleTree = createMatchTree(styleSheet, defaultStyleSheet);
+  if (!job.mpSnapshot) {
+    return;
+  }
 
-  reloadAllProperties();
+  // paths freed while the job was loading have been resolved for nothing
+  for (const auto* pPath : job.mPaths) {
+    if (mStyleSetPropsByPath.find(pPath) == mStyleSetPropsByPath.end()) {
+      job.mpSnapshot->forget(pPath);
+    }
+  }
+
+  reloadAllProperties(std::move(job.mpSnapshot));
 
   Q_EMIT styleChanged();
 }
 
-void StyleEngine::reloadAllProperties()
+void StyleEngine::reloadAllProperties(std::shared_ptr<StyleSnapshot> pSnapshot)
 {
-  mPropertyMaps.clear();
-
-  auto oldPropertyMapInstances = PropertyMapInstances{};
-  oldPropertyMapInstances.swap(mPropertyMapInstances);
+  // the old maps are kept until all props have been compared against them, so
+  // that only the props which actually changed notify their bindings
+  auto pOldSnapshot = mpSnapshot;
+  std::atomic_store(&mpSnapshot, std::move(pSnapshot));
 
+  // nobody listens to the unused props kept for reuse, so they are resolved
+  // again only when they are acquired the next time
   for (auto& element : mStyleSetPropsByPath) {
-    auto& pStyleSetProps = element.second;
-    pStyleSetProps->loadProperties();
+    auto& entry = element.second;
+    if (mLazyReload || entry.mUseCount == 0) {
+      entry.mpStyleSetProps->markStale();
+    } else {
+      entry.mpStyleSetProps->loadProperties();
+    }
   }
 }
 
@@ -360,81 +664,131 @@ QUrl StyleEngine::resolveResourceUrl(const QUrl& baseUrl, const QUrl& url) const
   return searchForResourceSearchPath(baseUrl, url, qmlEngine(this)->importPathList());
 }
 
-StyleSetProps* StyleEngine::styleSetProps(const UiItemPath& path)
+StyleSetProps* StyleEngine::acquireStyleSetProps(const PathNode* pPath)
 {
-  auto iElement = mStyleSetPropsByPath.find(path);
+  auto iElement = mStyleSetPropsByPath.find(pPath);
 
   if (iElement == mStyleSetPropsByPath.end()) {
-    std::tie(iElement, std::ignore) =
-      mStyleSetPropsByPath.emplace(path, estd::make_unique<StyleSetProps>(path, this));
+    std::tie(iElement, std::ignore) = mStyleSetPropsByPath.emplace(
+      pPath, StyleSetPropsEntry{estd::make_unique<StyleSetProps>(pPath, this), 0,
+                                mUnusedStyleSetProps.end()});
   }
 
-  return iElement->second.get();
+  auto& entry = iElement->second;
+  if (entry.mUseCount++ == 0 && entry.mUnusedPos != mUnusedStyleSetProps.end()) {
+    mUnusedStyleSetProps.erase(entry.mUnusedPos);
+    entry.mUnusedPos = mUnusedStyleSetProps.end();
+  }
+
+  return entry.mpStyleSetProps.get();
 }
 
-PropertyMap* StyleEngine::properties(const UiItemPath& path)
+void StyleEngine::releaseStyleSetProps(StyleSetProps* pStyleSetProps)
 {
-  return effectivePropertyMap(path);
+  auto iElement = mStyleSetPropsByPath.find(pStyleSetProps->path());
+  Q_ASSERT(iElement != mStyleSetPropsByPath.end());
+  Q_ASSERT(iElement->second.mUseCount > 0);
+
+  auto& entry = iElement->second;
+  if (--entry.mUseCount == 0) {
+    entry.mUnusedPos =
+      mUnusedStyleSetProps.insert(mUnusedStyleSetProps.begin(), iElement->first);
+    freeUnusedStyleSetProps(kMaxUnusedStyleSetProps);
+  }
 }
 
-PropertyMap* StyleEngine::effectivePropertyMap(const UiItemPath& path)
+void StyleEngine::freeUnusedStyleSetProps(std::size_t maxUnused)
 {
-  using std::begin;
-  using std::end;
-  using std::prev;
+  while (mUnusedStyleSetProps.size() > maxUnused) {
+    const auto* pPath = mUnusedStyleSetProps.back();
+    mUnusedStyleSetProps.pop_back();
 
-  const auto iElement = mPropertyMaps.find(path);
-  if (iElement != mPropertyMaps.end()) {
-    return iElement->second;
+    // paths below still hold on to the map and state they share with this one,
+    // ancestors only resolved on the way to it are dropped along with it
+    mStyleSetPropsByPath.erase(pPath);
+    mpSnapshot->forget(pPath);
   }
+}
 
-  auto props = matchPath(mpStyleTree.get(), path);
-
-  if (path.size() > 1) {
-    auto* pAncestorProps = effectivePropertyMap({begin(path), prev(end(path))});
+QVariantMap StyleEngine::cacheCounters() const
+{
+  const auto unused = mUnusedStyleSetProps.size();
 
-    if (props.empty()) {
-      // point to our ancestor props and return them immediately
-      // without storing our own props instance
-      mPropertyMaps.emplace(path, pAncestorProps);
-      return pAncestorProps;
-    } else {
-      props.insert(begin(*pAncestorProps), end(*pAncestorProps));
-    }
-  }
+  QVariantMap counters;
+  counters[QString::fromLatin1("liveStyleSetProps")] =
+    qulonglong(mStyleSetPropsByPath.size() - unused);
+  counters[QString::fromLatin1("unusedStyleSetProps")] = qulonglong(unused);
+  counters[QString::fromLatin1("propertyMaps")] =
+    qulonglong(mpSnapshot->propertyMapCount());
+  counters[QString::fromLatin1("matchStates")] =
+    qulonglong(mpSnapshot->matchStateCount());
+  counters[QString::fromLatin1("internedPaths")] = qulonglong(internedPathCount());
+  counters[QString::fromLatin1("atoms")] = qulonglong(atomCount());
+  return counters;
+}
 
-  mPropertyMapInstances.emplace_back(estd::make_unique<PropertyMap>(std::move(props)));
+const PropertyMap* StyleEngine::properties(const PathNode* pPath)
+{
+  // the snapshot keeps the map alive until the path is forgotten
+  return mpSnapshot->properties(pPath).get();
+}
 
-  auto* pProps = mPropertyMapInstances.back().get();
-  mPropertyMaps.emplace(path, pProps);
+unsigned int StyleEngine::generation() const
+{
+  return mpSnapshot->generation();
+}
 
-  return pProps;
+std::shared_ptr<const StyleSnapshot> StyleEngine::snapshot() const
+{
+  return std::atomic_load(&mpSnapshot);
 }
 
 void StyleEngine::SourceUrl::set(const QUrl& url,
                                  StyleEngine* pParent,
                                  QFileSystemWatcher& watcher)
 {
-  if (mSourceUrl.isLocalFile()) {
-    auto stylePath = qmlEngine(pParent)->baseUrl().resolved(mSourceUrl).toLocalFile();
-    if (!stylePath.isEmpty() && QFile(stylePath).exists()) {
-      watcher.removePath(stylePath);
+  for (const auto& filePath : watchedFiles(pParent)) {
+    if (QFile(filePath).exists()) {
+      watcher.removePath(filePath);
     }
   }
 
   mSourceUrl = url;
 
+  for (const auto& filePath : watchedFiles(pParent)) {
+    if (QFile(filePath).exists()) {
+      watcher.addPath(filePath);
+    }
+  }
+}
+
+void StyleEngine::SourceUrl::rewatch(StyleEngine* pParent,
+                                     QFileSystemWatcher& watcher) const
+{
+  for (const auto& filePath : watchedFiles(pParent)) {
+    if (QFile(filePath).exists() && !watcher.files().contains(filePath)) {
+      watcher.addPath(filePath);
+    }
+  }
+}
+
+QStringList StyleEngine::SourceUrl::watchedFiles(StyleEngine* pParent) const
+{
+  QStringList filePaths;
   if (mSourceUrl.isLocalFile()) {
     auto stylePath = qmlEngine(pParent)->baseUrl().resolved(mSourceUrl).toLocalFile();
-    if (!stylePath.isEmpty() && QFile(stylePath).exists()) {
-      watcher.addPath(stylePath);
+    if (!stylePath.isEmpty()) {
+      // the compiled image is loaded instead of the style sheet if it is newer
+      filePaths << stylePath << stylePath + kCompiledStyleSheetSuffix;
     }
   }
+  return filePaths;
 }
 
-QString StyleEngine::SourceUrl::toLocalFile(StyleEngine* pParent) const
+QString StyleEngine::SourceUrl::toLocalFileOrQrc(StyleEngine* pParent) const
 {
-  return qmlEngine(pParent)->baseUrl().resolved(mSourceUrl).toLocalFile();
+  return QQmlFile::urlToLocalFileOrQrc(
+    qmlEngine(pParent)->baseUrl().resolved(mSourceUrl));
 }
 
 } // namespace stylesheets
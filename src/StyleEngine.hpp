@@ -22,21 +22,30 @@ THE SOFTWARE.
 
 #pragma once
 
+#include "PathNode.hpp"
 #include "StyleMatchTree.hpp"
+#include "StyleSnapshot.hpp"
 #include "StylesDirWatcher.hpp"
 #include "Warnings.hpp"
 
 SUPPRESS_WARNINGS
+#include <QtCore/QByteArray>
 #include <QtCore/QDir>
 #include <QtCore/QFileSystemWatcher>
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtCore/QVariantList>
+#include <QtCore/QVariantMap>
 #include <QtQml/QQmlParserStatus>
 RESTORE_WARNINGS
 
+#include <cstddef>
+#include <list>
 #include <memory>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -82,6 +91,12 @@ class StyleEngineHost : public QObject
  * styleSheetSource and defaultStyleSheetSource properties.  Rules from the
  * former take precedence of the those from the later.
  *
+ * Style sheets can be precompiled into a binary form, which is loaded by
+ * mapping it into memory and skips parsing and building the match tree.  A
+ * precompiled @c .css.bin file is used instead of the @c .css file next to
+ * it if it is not older than the latter.  A source url can also refer to a
+ * @c .css.bin file directly.
+ *
  * @par Example
  * @code
  * ApplicationWindow {
@@ -199,7 +214,72 @@ class StyleEngine : public QObject, public QQmlParserStatus
                setDefaultStyleSheetSource NOTIFY defaultStyleSheetSourceChanged
                  REVISION 1)
 
+  /*! @public Defers resolving properties after a style sheet reload
+   *
+   * By default all properties in use are resolved when their StyleSet is
+   * created and again right after each reload, which allows notifying only
+   * the elements whose properties actually changed.  In lazy mode
+   * properties are only resolved when they are read.  A reload doesn't
+   * resolve any properties; it notifies those which have been read since
+   * they were last resolved, whether they changed or not, and their
+   * bindings resolve them again when they query them.  This makes loading
+   * cheaper when many elements have a StyleSet whose properties no binding
+   * ever reads, e.g. when StyleSets are only used for matching the elements
+   * below them.
+   *
+   * Default is false.
+   *
+   * @since 1.2
+   */
+  Q_PROPERTY(bool lazyReload READ lazyReload WRITE setLazyReload NOTIFY
+               lazyReloadChanged REVISION 2)
+
+  /*! @public Loads style sheets in the background
+   *
+   * By default style sheets are loaded on the GUI thread, which blocks it
+   * while parsing the sheets, building the match tree and resolving the
+   * properties again.  With asynchronous loading this happens on a worker
+   * thread and the result is swapped in on the GUI thread in one step.
+   * Until then all properties keep their previous values.
+   *
+   * Default is false.
+   *
+   * @since 1.2
+   */
+  Q_PROPERTY(bool asyncLoading READ asyncLoading WRITE setAsyncLoading NOTIFY
+               asyncLoadingChanged REVISION 2)
+
+  /*! @public The time in milliseconds to collect file changes before reloading
+   *
+   * Editors often save a file by writing a temporary file and renaming it, or
+   * save several style sheets at once.  Changes to the watched style sheet
+   * files are therefore collected until none came in for this long, and then
+   * handled with a single reload.  Style sheets whose content didn't change
+   * are not parsed again, and if neither did the reload is skipped.
+   *
+   * Default is 100.
+   *
+   * @since 1.2
+   */
+  Q_PROPERTY(int reloadDelay READ reloadDelay WRITE setReloadDelay NOTIFY
+               reloadDelayChanged REVISION 2)
+
 public:
+  /*! @public Returns the number of entries in the engine's caches
+   *
+   * The map holds the counts of StyleSetProps in use ("liveStyleSetProps")
+   * and kept for reuse ("unusedStyleSetProps"), of resolved paths
+   * ("propertyMaps") and their match states ("matchStates"), and of the paths
+   * and names interned by the process ("internedPaths", "atoms").
+   *
+   * Forgetting unused StyleSetProps brings the counts of resolved paths back
+   * down.  The process wide path and atom tables are never shrunk; they only
+   * grow with paths and names not seen before.
+   *
+   * @since 1.2
+   */
+  Q_REVISION(2) Q_INVOKABLE QVariantMap cacheCounters() const;
+
   /*! @cond DOXYGEN_IGNORE */
   explicit StyleEngine(QObject* pParent = nullptr);
   ~StyleEngine();
@@ -210,6 +290,15 @@ class StyleEngine : public QObject, public QQmlParserStatus
   QUrl defaultStyleSheetSource() const;
   void setDefaultStyleSheetSource(const QUrl& url);
 
+  bool lazyReload() const;
+  void setLazyReload(bool isLazy);
+
+  bool asyncLoading() const;
+  void setAsyncLoading(bool isAsync);
+
+  int reloadDelay() const;
+  void setReloadDelay(int msecs);
+
   /*! @deprecated Use StylesDirWatcher instead. */
   QUrl stylePath() const;
   /*! @deprecated Use StylesDirWatcher instead. */
@@ -240,7 +329,7 @@ class StyleEngine : public QObject, public QQmlParserStatus
   /*! @endcond */
 
   /*! @private */
-  std::string describeMatchedPath(const UiItemPath& path) const;
+  std::string describeMatchedPath(const PathNode* pPath) const;
 
   /*! Resolve @p url against @p baseUrl or search for it in a search path.
    *
@@ -249,33 +338,62 @@ class StyleEngine : public QObject, public QQmlParserStatus
    */
   QUrl resolveResourceUrl(const QUrl& baseUrl, const QUrl& url) const;
 
-  /*! Returns a pointer to StyleSetProps corresponding to @p path
+  /*! Returns a pointer to StyleSetProps corresponding to @p pPath
    *
-   * Subsequent calls with identical @p path will return pointers to
-   * the same StyleSetProps instance.
+   * Subsequent calls with identical @p pPath will return pointers to
+   * the same StyleSetProps instance as long as it is in use.  Each call
+   * must be balanced by a call to releaseStyleSetProps().
    *
-   * Will never return nullptr, but pointers will be invalidated if
-   * and only if this StyleEngine instance is destroyed. Clients should
+   * Will never return nullptr.  The pointer stays valid until it has been
+   * released or this StyleEngine instance is destroyed.  Clients should
    * listen to StyleSetProps::invalidated.
    */
-  StyleSetProps* styleSetProps(const UiItemPath& path);
+  StyleSetProps* acquireStyleSetProps(const PathNode* pPath);
 
-  /*! Returns a pointer to the PropertyMap corresponding to @p path
+  /*! Releases StyleSetProps returned by acquireStyleSetProps()
    *
-   * The element path @p path is matched against the rules loaded from the
+   * Unused StyleSetProps are kept for a while in case their path comes up
+   * again; the least recently used ones are freed together with the
+   * property map and match state of their path.
+   */
+  void releaseStyleSetProps(StyleSetProps* pStyleSetProps);
+
+  /*! Returns a pointer to the PropertyMap corresponding to @p pPath
+   *
+   * The element path @p pPath is matched against the rules loaded from the
    * current style sheet.  The resulting set of properties is returned.  If
    * the path is not matching any rule the result is an empty property map.
    *
-   * Subsequent calls with identical @p path will return pointers to the same
+   * Subsequent calls with identical @p pPath will return pointers to the same
    * PropertyMap instance.
    *
-   * Will never return nullptr, but pointers will be invalidated if and only
-   * if the style changes or this StyleEngine instance is destroyed.
+   * Will never return nullptr, but pointers will be invalidated if the style
+   * changes, the StyleSetProps of @p pPath are freed or this StyleEngine
+   * instance is destroyed.
+   */
+  const PropertyMap* properties(const PathNode* pPath);
+
+  /*! Returns the number of style reloads so far
+   *
+   * Property maps returned by properties() before the last reload are stale.
+   */
+  unsigned int generation() const;
+
+  /*! Returns the snapshot of the currently loaded styles
+   *
+   * Unlike the rest of the engine this function is thread safe.  The
+   * snapshot stays valid and unchanged as long as it is referenced, even
+   * when the style is reloaded in between; call snapshot() again to see the
+   * new style.
    */
-  PropertyMap* properties(const UiItemPath& path);
+  std::shared_ptr<const StyleSnapshot> snapshot() const;
 
 Q_SIGNALS:
-  /*! Fires when the style sheet is replaced or changed on the disk */
+  /*! Fires when the style sheet is replaced or changed on the disk
+   *
+   * It does not fire if the loaded style sheets turn out unchanged, which
+   * includes setting a source while no style sheet could be loaded before
+   * and none can be loaded now. */
   void styleChanged();
   /*! Fires when a new style sheet file name is set to the styleName property */
   void styleNameChanged();
@@ -309,15 +427,39 @@ class StyleEngine : public QObject, public QQmlParserStatus
    */
   Q_REVISION(1) void exception(const QString& type, const QString& message);
 
+  /*! Emitted when the lazyReload property changes.
+   *
+   * @since 1.2
+   */
+  Q_REVISION(2) void lazyReloadChanged();
+
+  /*! Emitted when the asyncLoading property changes.
+   *
+   * @since 1.2
+   */
+  Q_REVISION(2) void asyncLoadingChanged();
+
+  /*! Emitted when the reloadDelay property changes.
+   *
+   * @since 1.2
+   */
+  Q_REVISION(2) void reloadDelayChanged();
+
 private Q_SLOTS:
   void onFileChanged(const QString& path);
+  void onReloadTimeout();
+  void onStyleLoaded();
 
 private:
   class SourceUrl
   {
   public:
     void set(const QUrl& url, StyleEngine* pParent, QFileSystemWatcher& watcher);
-    QString toLocalFile(StyleEngine* pParent) const;
+    //! Watches the files again if they have been replaced since
+    void rewatch(StyleEngine* pParent, QFileSystemWatcher& watcher) const;
+    //! The local style sheet file and its compiled image, if any
+    QStringList watchedFiles(StyleEngine* pParent) const;
+    QString toLocalFileOrQrc(StyleEngine* pParent) const;
 
     QUrl url() const
     {
@@ -332,21 +474,37 @@ private Q_SLOTS:
     QUrl mSourceUrl;
   };
 
+  //! A loaded style sheet, which is reused as long as its file doesn't change
+  struct LoadedStyleSheet {
+    QString mFilePath;
+    QByteArray mHash;
+    std::shared_ptr<const StyleSheetImage> mpImage;
+  };
+
+  class LoadJob;
+
   void loadStyle();
-  StyleSheet loadStyleSheet(const SourceUrl& srcurl);
-  void resolveFontFaceDecl(const StyleSheet& styleSheet);
-  void reloadAllProperties();
+  QString styleSheetFilePath(const SourceUrl& srcurl);
+  void finishLoading(LoadJob& job);
+  void resolveFontFaceDecl(const StyleSheetImage& styleSheet);
+  void reloadAllProperties(std::shared_ptr<StyleSnapshot> pSnapshot);
 
   void updateSourceUrls();
 
-  PropertyMap* effectivePropertyMap(const UiItemPath& path);
+  void freeUnusedStyleSetProps(std::size_t maxUnused);
 
 private:
-  using StyleSetPropsByPath =
-    std::unordered_map<UiItemPath, std::unique_ptr<StyleSetProps>, UiItemPathHasher>;
+  using UnusedStyleSetProps = std::list<const PathNode*>;
 
-  using PropertyMapInstances = std::vector<std::unique_ptr<PropertyMap>>;
-  using PropertyMaps = std::unordered_map<UiItemPath, PropertyMap*, UiItemPathHasher>;
+  struct StyleSetPropsEntry {
+    std::unique_ptr<StyleSetProps> mpStyleSetProps;
+    std::size_t mUseCount;
+    //! the position in mUnusedStyleSetProps if mUseCount is 0
+    UnusedStyleSetProps::iterator mUnusedPos;
+  };
+
+  // interned paths are keyed by their address
+  using StyleSetPropsByPath = std::unordered_map<const PathNode*, StyleSetPropsEntry>;
 
   QUrl mStylePathUrl;        //!< @deprecated
   QString mStylePath;        //!< @deprecated
@@ -356,16 +514,29 @@ private Q_SLOTS:
   SourceUrl mStyleSheetSourceUrl;
   SourceUrl mDefaultStyleSheetSourceUrl;
 
-  std::unique_ptr<IStyleMatchTree> mpStyleTree;
+  std::shared_ptr<StyleSnapshot> mpSnapshot;
   QFileSystemWatcher mFsWatcher;
   StyleEngineHost::FontIdCache& mFontIdCache;
 
   StylesDirWatcher mStylesDir;
 
   StyleSetPropsByPath mStyleSetPropsByPath;
-
-  PropertyMapInstances mPropertyMapInstances;
-  PropertyMaps mPropertyMaps;
+  //! the paths of unused StyleSetProps, most recently used first
+  UnusedStyleSetProps mUnusedStyleSetProps;
+
+  bool mLazyReload;
+
+  LoadedStyleSheet mStyleSheet;
+  LoadedStyleSheet mDefaultStyleSheet;
+  //! collects file changes for reloadDelay
+  QTimer mReloadTimer;
+
+  bool mAsyncLoading;
+  //! the thread running mpLoadJob
+  std::thread mLoadThread;
+  std::unique_ptr<LoadJob> mpLoadJob;
+  //! the sources changed while mpLoadJob was running
+  bool mIsReloadPending;
 };
 
 } // namespace stylesheets
@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 #include "StyleMatchTree.hpp"
 #include "CssParser.hpp"
+#include "StyleSheetImage.hpp"
 
 #include "estd/memory.hpp"
 #include "Warnings.hpp"
@@ -38,7 +39,10 @@ RESTORE_WARNINGS
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <tuple>
@@ -57,9 +61,123 @@ const std::string kDescendantAxisId = "::desc::";
 const std::string kConjunctionIndicator = "&";
 const std::string kChildIndicator = ">";
 const std::string kDot = ".";
+const std::string kColon = ":";
 RESTORE_WARNINGS
 
-using PropertyDefMap = std::unordered_map<std::string, Property>;
+/*! The key of a match node's child
+ *
+ * Type names and the axis markers map to <tt>atom << 1</tt> and class names
+ * to <tt>(atom << 1) | 1</tt>, which keeps the class ".Foo" apart from the
+ * type "Foo" without building a dotted string for each lookup.  Pseudo-states
+ * are matched like class names; their atoms keep the leading colon.
+ */
+using MatchKey = std::uint32_t;
+
+MatchKey typeKey(AtomId atom)
+{
+  return atom << 1;
+}
+
+MatchKey classKey(AtomId atom)
+{
+  return (atom << 1) | 1;
+}
+
+bool isClassKey(MatchKey key)
+{
+  return (key & 1) != 0;
+}
+
+//! Returns the key for a part of a selector as returned by transformSelector()
+MatchKey selectorKey(const std::string& selPart)
+{
+  if (!selPart.empty() && selPart[0] == kDot[0]) {
+    return classKey(internAtom(selPart.substr(1)));
+  }
+  if (!selPart.empty() && selPart[0] == kColon[0]) {
+    return classKey(internAtom(selPart));
+  }
+  return typeKey(internAtom(selPart));
+}
+
+bool isPseudoStateAtom(AtomId atom)
+{
+  const auto& name = atomName(atom);
+  return !name.empty() && name[0] == kColon[0];
+}
+
+MatchKey descendantAxisKey()
+{
+  static const MatchKey key = selectorKey(kDescendantAxisId);
+  return key;
+}
+
+MatchKey conjunctionKey()
+{
+  static const MatchKey key = selectorKey(kConjunctionIndicator);
+  return key;
+}
+
+std::string keyName(MatchKey key)
+{
+  const auto atom = AtomId(key >> 1);
+  return isClassKey(key) && !isPseudoStateAtom(atom) ? kDot + atomName(atom)
+                                                      : atomName(atom);
+}
+
+/*! The process-wide assignment of pseudo-states to bits
+ *
+ * The predefined states take the lowest bits, custom states get the next
+ * free bit when first seen. */
+class PseudoStateTable
+{
+public:
+  PseudoStateTable()
+  {
+    for (const auto* state : {"hover", "pressed", "focus", "disabled"}) {
+      mAtoms.push_back(internAtom(kColon + state));
+    }
+  }
+
+  PseudoStateMask bit(const std::string& state)
+  {
+    const auto atom = internAtom(kColon + state);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = std::find(mAtoms.begin(), mAtoms.end(), atom);
+    if (it == mAtoms.end()) {
+      if (mAtoms.size() == kMaxStates) {
+        return 0;
+      }
+      it = mAtoms.insert(mAtoms.end(), atom);
+    }
+    return PseudoStateMask(1) << (it - mAtoms.begin());
+  }
+
+  void append(std::vector<AtomId>& classNames, PseudoStateMask states)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (std::size_t i = 0; i < mAtoms.size(); ++i) {
+      if (states & (PseudoStateMask(1) << i)) {
+        classNames.push_back(mAtoms[i]);
+      }
+    }
+  }
+
+private:
+  static const std::size_t kMaxStates = 8 * sizeof(PseudoStateMask);
+
+  std::mutex mMutex;
+  std::vector<AtomId> mAtoms;
+};
+
+PseudoStateTable& pseudoStateTable()
+{
+  static PseudoStateTable sPseudoStateTable;
+  return sPseudoStateTable;
+}
+
+using PropertyDefMap = std::unordered_map<AtomId, Property>;
 
 /*! The basic building block for a "match tree"
  *
@@ -94,6 +212,9 @@ using PropertyDefMap = std::unordered_map<std::string, Property>;
  *     Gaz -> {}
  *       Foo -> { properties }
  * @endcode
+ *
+ * The tree only exists while compiling a style sheet.  It is written to a
+ * StyleSheetImage and matched through the flat automaton built by Layer.
  */
 class MatchNode
 {
@@ -114,19 +235,387 @@ class MatchNode
 
   PropertyDefMap properties;
 
-  using Matches = std::unordered_map<std::string, std::unique_ptr<MatchNode>>;
+  using Matches = std::unordered_map<MatchKey, std::unique_ptr<MatchNode>>;
   Matches matches;
 };
 
-class StyleMatchTree : public IStyleMatchTree
+/*! Specificity for matching selectors
+ *
+ * This bascially works like CSS specificity computation, but since we
+ * don't support style arguments and IDs (CSS's most specific values) our
+ * specificity encodes two values only: class (incl. pseudo class and
+ * attribute) and elements. */
+class Specificity
+{
+public:
+  Specificity()
+    : mClass(0)
+    , mElements(0)
+  {
+  }
+
+  Specificity(const Specificity& other, int incClass, int incElements)
+    : mClass(other.mClass + incClass)
+    , mElements(other.mElements + incElements)
+  {
+  }
+
+  bool operator<(const Specificity& other) const
+  {
+    return std::tie(mClass, mElements) < std::tie(other.mClass, other.mElements);
+  }
+
+  bool operator==(const Specificity& other) const
+  {
+    return std::tie(mClass, mElements) == std::tie(other.mClass, other.mElements);
+  }
+
+  bool operator!=(const Specificity& other) const
+  {
+    return !(*this == other);
+  }
+
+  // int mStyle -- no style attribute!
+  // int mId -- no id!
+  int mClass;
+  int mElements;
+};
+
+std::ostream& operator<<(std::ostream& os, const Specificity& spec)
+{
+  os << "[" << spec.mClass << "," << spec.mElements << "]";
+  return os;
+}
+
+const AtomId kNoAtom = 0xffffffff;
+const std::uint32_t kNoBody = 0xffffffff;
+
+/*! A Bloom filter over match keys
+ *
+ * A path carries the filter of the keys of each element and its
+ * ancestors; a "::desc::" node carries the filter of the keys every match
+ * below it requires.  If the path's filter lacks any of the required bits,
+ * no ancestor can complete the match.
+ */
+class AncestorFilter
+{
+public:
+  static AncestorFilter none()
+  {
+    return AncestorFilter(0);
+  }
+
+  static AncestorFilter all()
+  {
+    return AncestorFilter(~std::uint64_t(0));
+  }
+
+  void add(MatchKey key)
+  {
+    const auto hash = key * 0x9e3779b1u;
+    set(hash >> 24);
+    set((hash >> 16) & 0xff);
+  }
+
+  bool containsAll(const AncestorFilter& other) const
+  {
+    for (std::size_t i = 0; i < kWords; ++i) {
+      if ((mBits[i] & other.mBits[i]) != other.mBits[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  AncestorFilter& operator|=(const AncestorFilter& other)
+  {
+    for (std::size_t i = 0; i < kWords; ++i) {
+      mBits[i] |= other.mBits[i];
+    }
+    return *this;
+  }
+
+  AncestorFilter& operator&=(const AncestorFilter& other)
+  {
+    for (std::size_t i = 0; i < kWords; ++i) {
+      mBits[i] &= other.mBits[i];
+    }
+    return *this;
+  }
+
+private:
+  static const std::size_t kWords = 4;
+
+  explicit AncestorFilter(std::uint64_t word)
+  {
+    std::fill(mBits, mBits + kWords, word);
+  }
+
+  void set(std::uint32_t bit)
+  {
+    mBits[bit / 64] |= std::uint64_t(1) << (bit % 64);
+  }
+
+  std::uint64_t mBits[kWords];
+};
+
+//! A node of a layer's matching automaton
+struct AutomatonNode {
+  //! the range of the node's type and class edges in Layer::mEdgeKeys
+  std::uint32_t mFirstEdge;
+  std::uint32_t mEdgeCount;
+  //! the index of the node's rule body or kNoBody
+  std::uint32_t mBody;
+  //! the targets of the "&" and "::desc::" edges or image::kNoNode
+  std::uint32_t mConjunction;
+  std::uint32_t mDescendant;
+  //! the match tree wide index of the "::desc::" target, see MatchScratch
+  std::uint32_t mDescendantSlot;
+};
+
+//! The property definitions of one or more selectors
+struct RuleBody {
+  std::uint32_t mFirstProperty;
+  std::uint32_t mPropertyCount;
+};
+
+/*! A compiled style sheet together with the source layer it is matched in
+ *
+ * When creating the layer the image's match tree is translated once into a
+ * matching automaton over this process' atoms: nodes are kept in the
+ * image's breadth-first order, the type and class edges of each node form a
+ * small sorted array of match keys, and the axis edges are resolved into
+ * node members.  Property definitions are referenced through rule bodies,
+ * which are shared by all nodes with the same definitions.  Matching only
+ * reads these arrays; the image is consulted for the matched rule bodies.
+ */
+class Layer
 {
 public:
-  StyleMatchTree()
-    : rootMatches(estd::make_unique<MatchNode>())
+  Layer(std::shared_ptr<const StyleSheetImage> pImage,
+        int index,
+        std::uint32_t firstDescendantSlot)
+    : mpImage(std::move(pImage))
+    , mIndex(index)
+    , mFirstDescendantSlot(firstDescendantSlot)
+    , mEndDescendantSlot(firstDescendantSlot)
+  {
+    const auto& img = *mpImage;
+
+    std::vector<MatchKey> stringKeys(img.stringCount(), 0);
+    std::vector<bool> isKey(img.stringCount(), false);
+    for (std::uint32_t i = 0; i < img.edgeCount(); ++i) {
+      const auto str = img.edge(i).mKey;
+      if (!isKey[str]) {
+        stringKeys[str] = selectorKey(img.string(str).to_string());
+        isKey[str] = true;
+      }
+    }
+
+    mPropertyAtoms.reserve(img.propertyCount());
+    for (std::uint32_t i = 0; i < img.propertyCount(); ++i) {
+      mPropertyAtoms.push_back(internAtom(img.string(img.property(i).mName).to_string()));
+    }
+
+    std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint32_t> bodies;
+    std::vector<std::pair<MatchKey, std::uint32_t>> edges;
+
+    mNodes.reserve(img.nodeCount());
+    for (std::uint32_t i = 0; i < img.nodeCount(); ++i) {
+      const auto& imgNode = img.node(i);
+      AutomatonNode node{static_cast<std::uint32_t>(mEdgeKeys.size()), 0, kNoBody,
+                         image::kNoNode, image::kNoNode, 0};
+
+      if (imgNode.mPropertyCount > 0) {
+        const auto range = std::make_pair(imgNode.mFirstProperty, imgNode.mPropertyCount);
+        const auto it = bodies.find(range);
+        if (it != bodies.end()) {
+          node.mBody = it->second;
+        } else {
+          node.mBody = static_cast<std::uint32_t>(mBodies.size());
+          mBodies.push_back(RuleBody{imgNode.mFirstProperty, imgNode.mPropertyCount});
+          bodies.emplace(range, node.mBody);
+        }
+      }
+
+      edges.clear();
+      const auto* pEdges = img.edges(imgNode);
+      for (std::uint32_t e = 0; e < imgNode.mEdgeCount; ++e) {
+        const auto key = stringKeys[pEdges[e].mKey];
+        if (key == conjunctionKey()) {
+          node.mConjunction = pEdges[e].mNode;
+        } else if (key == descendantAxisKey()) {
+          node.mDescendant = pEdges[e].mNode;
+          node.mDescendantSlot = mEndDescendantSlot++;
+        } else {
+          edges.emplace_back(key, pEdges[e].mNode);
+        }
+      }
+      std::sort(edges.begin(), edges.end());
+
+      for (const auto& edge : edges) {
+        mEdgeKeys.push_back(edge.first);
+        mEdgeTargets.push_back(edge.second);
+      }
+      node.mEdgeCount = static_cast<std::uint32_t>(edges.size());
+      mNodes.push_back(node);
+    }
+
+    computeSpecificities();
+    computeDescendantFilters();
+  }
+
+  const StyleSheetImage& image() const
   {
+    return *mpImage;
   }
 
-  std::unique_ptr<MatchNode> rootMatches;
+  int index() const
+  {
+    return mIndex;
+  }
+
+  //! Returns one past the last descendant slot used by this layer
+  std::uint32_t endDescendantSlot() const
+  {
+    return mEndDescendantSlot;
+  }
+
+  const AutomatonNode& node(std::uint32_t index) const
+  {
+    return mNodes[index];
+  }
+
+  //! Returns the specificity of the selector leading to @p node
+  const Specificity& specificity(std::uint32_t node) const
+  {
+    return mSpecificities[node];
+  }
+
+  //! Returns the keys required by all matches below the "::desc::" node
+  //! in @p slot
+  const AncestorFilter& descendantFilter(std::uint32_t slot) const
+  {
+    return mDescendantFilters[slot - mFirstDescendantSlot];
+  }
+
+  const RuleBody& body(std::uint32_t index) const
+  {
+    return mBodies[index];
+  }
+
+  //! Returns the child of @p node reached through @p key or image::kNoNode
+  std::uint32_t findChild(const AutomatonNode& node, MatchKey key) const
+  {
+    const auto* first = mEdgeKeys.data() + node.mFirstEdge;
+    const auto* last = first + node.mEdgeCount;
+
+    // most nodes have a handful of children only, which are cheaper to scan
+    const auto* it = node.mEdgeCount <= kLinearSearchLimit
+                       ? std::find_if(first, last, [key](MatchKey k) { return k >= key; })
+                       : std::lower_bound(first, last, key);
+
+    return it != last && *it == key ? mEdgeTargets[it - mEdgeKeys.data()]
+                                    : image::kNoNode;
+  }
+
+  const image::PropertyDef& property(std::uint32_t index) const
+  {
+    return mpImage->property(index);
+  }
+
+  AtomId propertyAtom(std::uint32_t index) const
+  {
+    return mPropertyAtoms[index];
+  }
+
+private:
+  static const std::uint32_t kLinearSearchLimit = 8;
+
+  // every node stands for the selector of the keys leading to it
+  void computeSpecificities()
+  {
+    mSpecificities.resize(mNodes.size());
+
+    for (std::size_t i = 0; i < mNodes.size(); ++i) {
+      const auto& node = mNodes[i];
+      const auto& specificity = mSpecificities[i];
+
+      for (auto e = node.mFirstEdge; e < node.mFirstEdge + node.mEdgeCount; ++e) {
+        mSpecificities[mEdgeTargets[e]] = isClassKey(mEdgeKeys[e])
+                                            ? Specificity(specificity, 1, 0)
+                                            : Specificity(specificity, 0, 1);
+      }
+      if (node.mConjunction != image::kNoNode) {
+        mSpecificities[node.mConjunction] = specificity;
+      }
+      if (node.mDescendant != image::kNoNode) {
+        mSpecificities[node.mDescendant] = specificity;
+      }
+    }
+  }
+
+  // A match continuing below a node has to take one of its edges.  An edge
+  // with a key requires that key and, unless the rule may end at its
+  // target, what the target requires; axis edges require what their
+  // target requires.  The filter of a node is thus the intersection over
+  // its edges.  Children have higher indices than their parents, so one
+  // backwards pass suffices.
+  void computeDescendantFilters()
+  {
+    std::vector<AncestorFilter> required(mNodes.size(), AncestorFilter::all());
+    mDescendantFilters.resize(mEndDescendantSlot - mFirstDescendantSlot,
+                              AncestorFilter::all());
+
+    for (auto i = mNodes.size(); i-- > 0;) {
+      const auto& node = mNodes[i];
+      auto& filter = required[i];
+
+      for (auto e = node.mFirstEdge; e < node.mFirstEdge + node.mEdgeCount; ++e) {
+        const auto child = mEdgeTargets[e];
+        auto edgeFilter =
+          mNodes[child].mBody != kNoBody ? AncestorFilter::none() : required[child];
+        edgeFilter.add(mEdgeKeys[e]);
+        filter &= edgeFilter;
+      }
+      if (node.mConjunction != image::kNoNode) {
+        filter &= required[node.mConjunction];
+      }
+      if (node.mDescendant != image::kNoNode) {
+        filter &= required[node.mDescendant];
+        mDescendantFilters[node.mDescendantSlot - mFirstDescendantSlot] =
+          required[node.mDescendant];
+      }
+    }
+  }
+
+  std::shared_ptr<const StyleSheetImage> mpImage;
+  int mIndex;
+  std::uint32_t mFirstDescendantSlot;
+  std::uint32_t mEndDescendantSlot;
+  std::vector<AutomatonNode> mNodes;
+  //! the keys of all type and class edges, sorted per node
+  std::vector<MatchKey> mEdgeKeys;
+  //! the target node of each edge in mEdgeKeys
+  std::vector<std::uint32_t> mEdgeTargets;
+  std::vector<RuleBody> mBodies;
+  std::vector<Specificity> mSpecificities;
+  //! the required keys of each "::desc::" node by descendant slot
+  std::vector<AncestorFilter> mDescendantFilters;
+  //! the atom of each property definition's name
+  std::vector<AtomId> mPropertyAtoms;
+};
+
+class StyleMatchTree : public IStyleMatchTree
+{
+public:
+  //! the compiled style sheets in ascending order of source layers
+  std::vector<Layer> layers;
+
+  std::uint32_t descendantSlotCount() const
+  {
+    return layers.empty() ? 0 : layers.back().endDescendantSlot();
+  }
 };
 
 PropertyDefMap makeProperties(const std::vector<PropertySpec>& props,
@@ -139,7 +628,7 @@ PropertyDefMap makeProperties(const std::vector<PropertySpec>& props,
     propSrcLoc.mSourceLayer = sourceLayer;
 
     auto propDef = Property(propSrcLoc, prop.values);
-    properties.insert(std::make_pair(prop.name, propDef));
+    properties.insert(std::make_pair(internAtom(prop.name), propDef));
   }
 
   return properties;
@@ -161,7 +650,7 @@ void mergePropertyDefs(PropertyDefMap& dest, const PropertyDefMap& src)
 }
 
 MatchNode* matchAndInsertSel(MatchNode* node,
-                             const std::string& sel,
+                             MatchKey sel,
                              const PropertyDefMap* pProperties)
 {
   auto it = node->matches.find(sel);
@@ -221,10 +710,130 @@ void mergePropSet(MatchNode* parent, int sourceLayer, const PropertySpecSet& ps)
 
     for (auto sel = selector.rbegin(), end = std::prev(selector.rend()); sel != end;
          ++sel) {
-      node = matchAndInsertSel(node, *sel, nullptr);
+      node = matchAndInsertSel(node, selectorKey(*sel), nullptr);
     }
 
-    node = matchAndInsertSel(node, selector.front(), &properties);
+    node = matchAndInsertSel(node, selectorKey(selector.front()), &properties);
+  }
+}
+
+void writeValue(StyleSheetImageBuilder& builder,
+                std::size_t valueIndex,
+                const PropertyValue& value)
+{
+  class ValueWriter : public boost::static_visitor<image::Value>
+  {
+    StyleSheetImageBuilder& mBuilder;
+
+  public:
+    ValueWriter(StyleSheetImageBuilder& builder)
+      : mBuilder(builder)
+    {
+    }
+
+    image::Value operator()(const std::string& str)
+    {
+      return image::Value{image::kString, mBuilder.addString(str), 0, 0};
+    }
+
+    image::Value operator()(const Expression& expr)
+    {
+      const auto firstArg = static_cast<std::uint32_t>(mBuilder.args.size());
+      for (const auto& arg : expr.args) {
+        mBuilder.args.push_back(mBuilder.addString(arg));
+      }
+      return image::Value{image::kExpression, mBuilder.addString(expr.name), firstArg,
+                          static_cast<std::uint32_t>(expr.args.size())};
+    }
+  };
+
+  ValueWriter writer(builder);
+  builder.values[valueIndex] = boost::apply_visitor(writer, value);
+}
+
+//! Maps the (name, byte offset) pairs of written property sets to their
+//! first property index
+using WrittenPropertySets =
+  std::map<std::vector<std::pair<AtomId, int>>, std::uint32_t>;
+
+// writes @p properties unless the same definitions have been written before.
+// Returns the index of the first property.
+std::uint32_t writeProperties(StyleSheetImageBuilder& builder,
+                              WrittenPropertySets& written,
+                              const PropertyDefMap& properties)
+{
+  // sort by name to make the image independent of the hash map's order
+  std::vector<const PropertyDefMap::value_type*> sorted;
+  for (const auto& propdef : properties) {
+    sorted.push_back(&propdef);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const PropertyDefMap::value_type* lhs,
+               const PropertyDefMap::value_type* rhs) {
+              return atomName(lhs->first) < atomName(rhs->first);
+            });
+
+  // a declaration is identified by its source position, so selector lists
+  // like "A, B { ... }" share one set of definitions
+  std::vector<std::pair<AtomId, int>> identity;
+  for (const auto* propdef : sorted) {
+    identity.emplace_back(propdef->first, propdef->second.mSourceLoc.mByteOfs);
+  }
+  const auto it = written.find(identity);
+  if (it != written.end()) {
+    return it->second;
+  }
+
+  const auto firstProperty = static_cast<std::uint32_t>(builder.properties.size());
+  for (const auto* propdef : sorted) {
+    const auto& values = propdef->second.mValues;
+    const auto firstValue = builder.values.size();
+    builder.values.resize(firstValue + values.size());
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      writeValue(builder, firstValue + i, values[i]);
+    }
+
+    builder.properties.push_back(image::PropertyDef{
+      builder.addString(atomName(propdef->first)),
+      static_cast<std::uint32_t>(propdef->second.mSourceLoc.mByteOfs),
+      static_cast<std::uint32_t>(firstValue), static_cast<std::uint32_t>(values.size())});
+  }
+
+  written.emplace(std::move(identity), firstProperty);
+  return firstProperty;
+}
+
+// writes the tree below @p root in breadth-first order, which keeps the
+// upper levels that every match visits and the children of each node close
+// to each other.
+void writeMatchTree(StyleSheetImageBuilder& builder, const MatchNode& root)
+{
+  WrittenPropertySets written;
+  std::vector<const MatchNode*> queue(1, &root);
+
+  for (std::size_t index = 0; index < queue.size(); ++index) {
+    const auto& node = *queue[index];
+
+    const auto firstProperty =
+      node.properties.empty() ? 0 : writeProperties(builder, written, node.properties);
+
+    // edges are sorted by the string index of their key
+    std::vector<std::pair<std::uint32_t, const MatchNode*>> children;
+    for (const auto& child : node.matches) {
+      children.emplace_back(builder.addString(keyName(child.first)), child.second.get());
+    }
+    std::sort(children.begin(), children.end());
+
+    const auto firstEdge = static_cast<std::uint32_t>(builder.edges.size());
+    for (const auto& child : children) {
+      builder.edges.push_back(
+        image::Edge{child.first, static_cast<std::uint32_t>(queue.size())});
+      queue.push_back(child.second);
+    }
+
+    builder.nodes.push_back(
+      image::Node{firstEdge, static_cast<std::uint32_t>(children.size()), firstProperty,
+                  static_cast<std::uint32_t>(node.properties.size())});
   }
 }
 
@@ -233,17 +842,52 @@ void mergePropSet(MatchNode* parent, int sourceLayer, const PropertySpecSet& ps)
 #define DEFAULT_STYLESHEET_LAYER 0
 #define USER_STYLESHEET_LAYER 1
 
+std::shared_ptr<const StyleSheetImage> compileStyleSheet(const StyleSheet& stylesheet)
+{
+  MatchNode root;
+  for (const auto& ps : stylesheet.propsets) {
+    mergePropSet(&root, 0, ps);
+  }
+
+  StyleSheetImageBuilder builder;
+  writeMatchTree(builder, root);
+
+  for (const auto& ffd : stylesheet.fontfaces) {
+    builder.fontFaces.push_back(builder.addString(ffd.url));
+  }
+
+  const auto lineIndex =
+    stylesheet.lineIndex ? stylesheet.lineIndex : std::make_shared<SourceLineIndex>();
+  for (auto lineStart : lineIndex->lineStarts()) {
+    builder.lineStarts.push_back(static_cast<std::uint32_t>(lineStart));
+  }
+
+  return StyleSheetImage::fromBuffer(builder.finish());
+}
+
+IStyleMatchTree::~IStyleMatchTree()
+{
+}
+
 std::unique_ptr<IStyleMatchTree> createMatchTree(const StyleSheet& stylesheet,
                                                  const StyleSheet& defaultStylesheet)
 {
-  auto result = estd::make_unique<StyleMatchTree>();
+  return createMatchTree(
+    compileStyleSheet(stylesheet), compileStyleSheet(defaultStylesheet));
+}
 
-  for (auto ps : defaultStylesheet.propsets) {
-    mergePropSet(result->rootMatches.get(), DEFAULT_STYLESHEET_LAYER, ps);
+std::unique_ptr<IStyleMatchTree> createMatchTree(
+  std::shared_ptr<const StyleSheetImage> stylesheet,
+  std::shared_ptr<const StyleSheetImage> defaultStylesheet)
+{
+  auto result = estd::make_unique<StyleMatchTree>();
+  if (defaultStylesheet) {
+    result->layers.emplace_back(std::move(defaultStylesheet), DEFAULT_STYLESHEET_LAYER,
+                                result->descendantSlotCount());
   }
-
-  for (auto ps : stylesheet.propsets) {
-    mergePropSet(result->rootMatches.get(), USER_STYLESHEET_LAYER, ps);
+  if (stylesheet) {
+    result->layers.emplace_back(std::move(stylesheet), USER_STYLESHEET_LAYER,
+                                result->descendantSlotCount());
   }
 
   return std::move(result);
@@ -252,284 +896,450 @@ std::unique_ptr<IStyleMatchTree> createMatchTree(const StyleSheet& stylesheet,
 namespace
 {
 
-/*! Specificity for matching selectors
+//! A rule body reached by matching a path
+class MatchedRule
+{
+public:
+  MatchedRule(Specificity specificity, const Layer* pLayer, std::uint32_t body)
+    : mSpecificity(specificity)
+    , mpLayer(pLayer)
+    , mBody(body)
+  {
+  }
+
+  Specificity mSpecificity;
+  const Layer* mpLayer;
+  std::uint32_t mBody;
+};
+
+//! A property definition of a matched rule together with its order key
+class MatchedProperty
+{
+public:
+  MatchedProperty(std::uint64_t orderKey,
+                  AtomId name,
+                  const Layer* pLayer,
+                  const image::PropertyDef* pDef)
+    : mOrderKey(orderKey)
+    , mName(name)
+    , mpLayer(pLayer)
+    , mpDef(pDef)
+  {
+  }
+
+  std::uint64_t mOrderKey;
+  AtomId mName;
+  const Layer* mpLayer;
+  const image::PropertyDef* mpDef;
+};
+
+/*! Orders property definitions like the cascade does
  *
- * This bascially works like CSS specificity computation, but since we
- * don't support style arguments and IDs (CSS's most specific values) our
- * specificity encodes two values only: class (incl. pseudo class and
- * attribute) and elements. */
-class Specificity
+ * Definitions compare by specificity first and by source location (layer,
+ * byte offset) second; the greater one wins.  Packing the three into one
+ * integer makes sorting a plain integer comparison.
+ */
+std::uint64_t orderKey(const Specificity& specificity, int layer, std::uint32_t byteOfs)
+{
+  const auto clamp = [](int n) { return std::uint64_t(std::min(std::max(n, 0), 0xfff)); };
+  return clamp(specificity.mClass) << 52 | clamp(specificity.mElements) << 40
+         | std::uint64_t(layer & 0xff) << 32 | byteOfs;
+}
+
+//! Adds the keys of @p element to @p filter
+void addElementKeys(AncestorFilter& filter, const PathElement& element)
+{
+  filter.add(typeKey(element.mTypeName));
+  for (const auto className : element.mClassNames) {
+    filter.add(classKey(className));
+  }
+}
+
+/*! A path prefix prepared for matching
+ *
+ * A state keeps the element of its path, a reference to its parent's state
+ * and the ancestor filter of the path, which is derived from the parent's.
+ * Extending a state thus only looks at the new element, and matching the
+ * state's path takes the prefix from the chain of states instead of
+ * rebuilding it.  The matching itself is done by the Matcher like for any
+ * other path.  States are immutable and can be shared by several threads.
+ */
+class MatchState : public IMatchState
 {
 public:
-  Specificity()
-    : mClass(0)
-    , mElements(0)
+  explicit MatchState(const StyleMatchTree* pTree)
+    : mpTree(pTree)
+    , mElement(kNoAtom)
+    , mAncestorFilter(AncestorFilter::none())
+    , mDepth(0)
   {
   }
 
-  Specificity(const Specificity& other, int incClass, int incElements)
-    : mClass(other.mClass + incClass)
-    , mElements(other.mElements + incElements)
+  MatchState(std::shared_ptr<const MatchState> pParent, const PathElement& element)
+    : mpTree(pParent->mpTree)
+    , mpParent(std::move(pParent))
+    , mElement(element)
+    , mAncestorFilter(mpParent->mAncestorFilter)
+    , mDepth(mpParent->mDepth + 1)
   {
+    addElementKeys(mAncestorFilter, mElement);
   }
 
-  bool operator<(const Specificity& other) const
+  const StyleMatchTree& tree() const
   {
-    return std::tie(mClass, mElements) < std::tie(other.mClass, other.mElements);
+    return *mpTree;
   }
 
-  bool operator==(const Specificity& other) const
+  //! Returns the state of the path without its last element or nullptr for
+  //! the empty path
+  const MatchState* parent() const
   {
-    return std::tie(mClass, mElements) == std::tie(other.mClass, other.mElements);
+    return mpParent.get();
   }
 
-  bool operator!=(const Specificity& other) const
+  const PathElement& element() const
   {
-    return !(*this == other);
+    return mElement;
   }
 
-  // int mStyle -- no style attribute!
-  // int mId -- no id!
-  int mClass;
-  int mElements;
+  //! Returns the filter of the keys of all elements of the path
+  const AncestorFilter& ancestorFilter() const
+  {
+    return mAncestorFilter;
+  }
+
+  std::size_t depth() const
+  {
+    return mDepth;
+  }
+
+private:
+  const StyleMatchTree* mpTree;
+  std::shared_ptr<const MatchState> mpParent;
+  PathElement mElement;
+  AncestorFilter mAncestorFilter;
+  std::size_t mDepth;
 };
 
-std::ostream& operator<<(std::ostream& os, const Specificity& spec)
-{
-  os << "[" << spec.mClass << "," << spec.mElements << "]";
-  return os;
-}
+//! The part of the path a "::desc::" node has been matched against
+struct DescendantVisit {
+  std::uint32_t mGeneration;
+  //! the node has been matched against all positions from here to the root
+  std::uint32_t mFirstPosition;
+};
 
-class MatchRec
+class MatchScratch : public IMatchScratch
 {
 public:
-  using Nodes = std::vector<std::tuple<Specificity, const MatchNode*>>;
-
-  MatchRec()
+  MatchScratch()
+    : mDepth(0)
+    , mGeneration(0)
   {
   }
 
-  MatchRec(const Nodes& pNodes_)
-    : pNodes(pNodes_)
+  //! Prepares the positions and descendant visits for a new match of
+  //! @p path against @p tree
+  void startMatch(const StyleMatchTree& tree, const UiItemPath& path)
   {
+    resizePositions(path.size());
+
+    auto filter = AncestorFilter::none();
+    for (std::size_t i = 0; i < path.size(); ++i) {
+      addElementKeys(filter, path[i]);
+      mElements[path.size() - 1 - i] = &path[i];
+      mAncestorFilters[path.size() - 1 - i] = filter;
+    }
+
+    startVisits(tree);
   }
 
-  MatchRec& operator+=(const MatchRec& rhs)
+  //! Like startMatch() for the path of @p state, whose ancestor filters are
+  //! taken from the states
+  void startMatch(const MatchState& state)
   {
-    pNodes.insert(pNodes.end(), rhs.pNodes.begin(), rhs.pNodes.end());
-    return *this;
+    resizePositions(state.depth());
+
+    auto position = std::size_t(0);
+    for (auto* pState = &state; pState->parent(); pState = pState->parent()) {
+      mElements[position] = &pState->element();
+      mAncestorFilters[position] = pState->ancestorFilter();
+      ++position;
+    }
+
+    startVisits(state.tree());
   }
 
-  Nodes pNodes;
-};
+  std::vector<MatchedRule> mRules;
+  std::vector<MatchedProperty> mProperties;
 
-using MatchTuple = std::tuple<Specificity, PropertyDefMap>;
-using MatchResult = std::vector<MatchTuple>;
+  //! the elements of the path and the filters of the keys of each element
+  //! and its ancestors, indexed by position counted from the end of the path
+  std::vector<const PathElement*> mElements;
+  std::vector<AncestorFilter> mAncestorFilters;
+  std::size_t mDepth;
 
-void findDescendantMatchOnNode(MatchResult& result,
-                               Specificity specificity,
-                               const MatchNode* node,
-                               const PathElement& pathElt,
-                               UiItemPath::const_reverse_iterator nextEltIter,
-                               UiItemPath::const_reverse_iterator pathEltEnd);
+  std::vector<DescendantVisit> mDescendantVisits;
+  std::uint32_t mGeneration;
 
-void iterateOverMatches(MatchResult& result,
-                        const MatchRec m,
-                        const PathElement& pathElt,
-                        UiItemPath::const_reverse_iterator nextEltIter,
-                        UiItemPath::const_reverse_iterator pathEltEnd);
+private:
+  void resizePositions(std::size_t depth)
+  {
+    if (mElements.size() < depth) {
+      mElements.resize(depth, nullptr);
+      mAncestorFilters.resize(depth, AncestorFilter::none());
+    }
+    mDepth = depth;
+  }
 
-Specificity getMatchRecSpecificity(const std::tuple<Specificity, const MatchNode*>& tuple)
-{
-  return std::get<0>(tuple);
-}
+  void startVisits(const StyleMatchTree& tree)
+  {
+    if (mDescendantVisits.size() < tree.descendantSlotCount()) {
+      mDescendantVisits.resize(tree.descendantSlotCount(), DescendantVisit{0, 0});
+    }
 
-const MatchNode* getMatchRecNode(const std::tuple<Specificity, const MatchNode*>& tuple)
-{
-  return std::get<1>(tuple);
-}
+    // entries of earlier matches are recognized by their generation, which
+    // saves clearing them
+    if (++mGeneration == 0) {
+      std::fill(mDescendantVisits.begin(), mDescendantVisits.end(),
+                DescendantVisit{0, 0});
+      mGeneration = 1;
+    }
+  }
+};
 
-Specificity getMatchSpecificity(const MatchTuple& tuple)
+/*! Walks the match tree of one layer for the path prepared in a scratch buffer
+ *
+ * The path is matched from its last element upwards.  Matched rules are
+ * recorded in the scratch buffer, which is the only memory written to.
+ *
+ * A "::desc::" node matches if any ancestor matches one of its keys, so
+ * every node below it has to be tried against all remaining positions of
+ * the path.  Since the outcome of matching a node at a position does not
+ * depend on how the node was reached, each "::desc::" node is matched at
+ * most once per position, which bounds the work by O(nodes × depth).
+ * Before that the node's required keys are checked against the ancestor
+ * filter of the path, which rejects most descendant selectors right away.
+ */
+class Matcher
 {
-  return std::get<0>(tuple);
-}
+public:
+  Matcher(MatchScratch& scratch, const Layer& layer)
+    : mRules(scratch.mRules)
+    , mLayer(layer)
+    , mppElements(scratch.mElements.data())
+    , mpAncestorFilters(scratch.mAncestorFilters.data())
+    , mDepth(static_cast<std::uint32_t>(scratch.mDepth))
+    , mpVisits(scratch.mDescendantVisits.data())
+    , mGeneration(scratch.mGeneration)
+  {
+  }
 
-const PropertyDefMap& getMatchProperties(const MatchTuple& tuple)
-{
-  return std::get<1>(tuple);
-}
+  void match()
+  {
+    matchPathElement(0, 0);
+  }
 
-MatchRec findPattern(MatchResult& result,
-                     Specificity specificity,
-                     const MatchNode* node,
-                     const std::string& name)
-{
-  auto found = node->matches.find(name);
-  if (found != node->matches.end()) {
-    auto const* nd = found->second.get();
-    if (!nd->properties.empty()) {
-      result.emplace_back(std::make_tuple(specificity, nd->properties));
-    }
+private:
+  //! Matches the keys of the element at @p position against the children of
+  //! @p node.
+  void matchPathElement(std::uint32_t node, std::uint32_t position)
+  {
+    const auto& elt = *mppElements[position];
+    matchKey(node, typeKey(elt.mTypeName), position);
 
-    return MatchRec({std::make_tuple(specificity, nd)});
+    for (const auto className : elt.mClassNames) {
+      matchKey(node, classKey(className), position);
+    }
   }
 
-  return MatchRec();
-}
+  void matchKey(std::uint32_t node, MatchKey key, std::uint32_t position)
+  {
+    const auto child = mLayer.findChild(mLayer.node(node), key);
+    if (child == image::kNoNode) {
+      return;
+    }
 
-MatchRec findPathElement(MatchResult& result,
-                         Specificity specificity,
-                         const MatchNode* node,
-                         const PathElement& pathElt)
-{
-  auto matchRec =
-    findPattern(result, Specificity(specificity, 0, 1), node, pathElt.mTypeName);
+    const auto body = mLayer.node(child).mBody;
+    if (body != kNoBody) {
+      mRules.emplace_back(mLayer.specificity(child), &mLayer, body);
+    }
 
-  for (const auto& className : pathElt.mClassNames) {
-    std::string dotName(kDot + className);
-    auto m2 = findPattern(result, Specificity(specificity, 1, 0), node, dotName);
-    matchRec += m2;
+    followAxes(child, position);
   }
 
-  return matchRec;
-}
+  void followAxes(std::uint32_t node, std::uint32_t position)
+  {
+    const auto& automatonNode = mLayer.node(node);
 
-void findMatchOnNode(MatchResult& result,
-                     Specificity specificity,
-                     const MatchNode* node,
-                     const PathElement& pathElt,
-                     UiItemPath::const_reverse_iterator nextEltIter,
-                     UiItemPath::const_reverse_iterator pathEltEnd)
-{
-  auto m = findPathElement(result, specificity, node, pathElt);
-  iterateOverMatches(result, m, pathElt, nextEltIter, pathEltEnd);
-}
+    const auto conjunction = automatonNode.mConjunction;
+    if (conjunction != image::kNoNode) {
+      matchPathElement(conjunction, position);
+    }
 
-void iterateOverMatches(MatchResult& result,
-                        const MatchRec matchRec,
-                        const PathElement& pathElt,
-                        UiItemPath::const_reverse_iterator nextEltIter,
-                        UiItemPath::const_reverse_iterator pathEltEnd)
-{
-  auto tryToMatchConjunction = [&](Specificity specificity, const MatchNode* node) {
-    auto m = findPattern(result, specificity, node, kConjunctionIndicator);
-    for (const auto& tup : m.pNodes) {
-      findMatchOnNode(result, getMatchRecSpecificity(tup), getMatchRecNode(tup), pathElt,
-                      nextEltIter, pathEltEnd);
+    const auto next = position + 1;
+    if (next != mDepth) {
+      matchPathElement(node, next);
+
+      if (automatonNode.mDescendant != image::kNoNode) {
+        matchDescendant(automatonNode, next);
+      }
     }
-  };
+  }
 
-  auto tryToMatchChild = [&](Specificity specificity, const MatchNode* node) {
-    if (nextEltIter != pathEltEnd) {
-      findMatchOnNode(
-        result, specificity, node, *nextEltIter, std::next(nextEltIter), pathEltEnd);
+  void matchDescendant(const AutomatonNode& parent, std::uint32_t position)
+  {
+    if (!mpAncestorFilters[position].containsAll(
+          mLayer.descendantFilter(parent.mDescendantSlot))) {
+      return;
     }
-  };
 
-  auto tryToMatchDescendant = [&](Specificity specificity, const MatchNode* node) {
-    if (nextEltIter != pathEltEnd) {
-      auto m = findPattern(result, specificity, node, kDescendantAxisId);
-      for (const auto& tup : m.pNodes) {
-        findDescendantMatchOnNode(result, getMatchRecSpecificity(tup),
-                                  getMatchRecNode(tup), *nextEltIter,
-                                  std::next(nextEltIter), pathEltEnd);
+    auto last = mDepth;
+
+    auto& visit = mpVisits[parent.mDescendantSlot];
+    if (visit.mGeneration == mGeneration) {
+      if (visit.mFirstPosition <= position) {
+        return;
       }
+      last = visit.mFirstPosition;
     }
-  };
+    visit.mGeneration = mGeneration;
+    visit.mFirstPosition = position;
 
-  for (const auto& tup : matchRec.pNodes) {
-    auto specificity = getMatchRecSpecificity(tup);
-    auto node = getMatchRecNode(tup);
-    tryToMatchConjunction(specificity, node);
-    tryToMatchChild(specificity, node);
-    tryToMatchDescendant(specificity, node);
+    for (; position != last; ++position) {
+      matchPathElement(parent.mDescendant, position);
+    }
   }
-}
 
-void findDescendantMatchOnNode(MatchResult& result,
-                               Specificity specificity,
-                               const MatchNode* node,
-                               const PathElement& pathElt,
-                               UiItemPath::const_reverse_iterator nextEltIter,
-                               UiItemPath::const_reverse_iterator pathEltEnd)
+  std::vector<MatchedRule>& mRules;
+  const Layer& mLayer;
+  const PathElement* const* mppElements;
+  const AncestorFilter* mpAncestorFilters;
+  std::uint32_t mDepth;
+  DescendantVisit* mpVisits;
+  std::uint32_t mGeneration;
+};
+
+//! Removes rules reached through several ancestors or selectors
+void removeDuplicateRules(std::vector<MatchedRule>& rules)
 {
-  auto m = findPathElement(result, specificity, node, pathElt);
-  if (m.pNodes.empty()) {
-    if (nextEltIter != pathEltEnd) {
-      findDescendantMatchOnNode(
-        result, specificity, node, *nextEltIter, std::next(nextEltIter), pathEltEnd);
-    }
-  } else {
-    iterateOverMatches(result, m, pathElt, nextEltIter, pathEltEnd);
-  }
+  std::sort(rules.begin(), rules.end(),
+            [](const MatchedRule& lhs, const MatchedRule& rhs) {
+              return std::make_tuple(lhs.mpLayer->index(), lhs.mBody,
+                                     lhs.mSpecificity.mClass, lhs.mSpecificity.mElements)
+                     < std::make_tuple(rhs.mpLayer->index(), rhs.mBody,
+                                       rhs.mSpecificity.mClass,
+                                       rhs.mSpecificity.mElements);
+            });
+  rules.erase(std::unique(rules.begin(), rules.end(),
+                          [](const MatchedRule& lhs, const MatchedRule& rhs) {
+                            return lhs.mpLayer == rhs.mpLayer && lhs.mBody == rhs.mBody
+                                   && lhs.mSpecificity == rhs.mSpecificity;
+                          }),
+              rules.end());
 }
 
-MatchResult findMatchingRules(const StyleMatchTree& tree, const UiItemPath& path)
+//! Finds the rules matching the path prepared with MatchScratch::startMatch()
+void findMatchingRules(const StyleMatchTree& tree, MatchScratch& scratch)
 {
-  MatchResult result;
+  auto& rules = scratch.mRules;
+  rules.clear();
 
-  UiItemPath::const_reverse_iterator pathEltIter = path.rbegin();
-  if (pathEltIter != path.rend()) {
-    findMatchOnNode(result, Specificity(), tree.rootMatches.get(), *pathEltIter,
-                    std::next(pathEltIter), path.rend());
+  if (scratch.mDepth > 0) {
+    for (const auto& layer : tree.layers) {
+      Matcher(scratch, layer).match();
+    }
   }
 
-  return result;
+  removeDuplicateRules(rules);
 }
 
-void sortMatchResults(MatchResult& result)
+//! Expands the rules in @p scratch to the effective property definitions
+std::size_t resolveProperties(MatchScratch& scratch)
 {
-  std::sort(
-    result.begin(), result.end(), [](const MatchTuple& lhs, const MatchTuple& rhs) {
-      return getMatchSpecificity(lhs) < getMatchSpecificity(rhs);
-    });
-}
-
-using SourceLocationMap = std::unordered_map<std::string, SourceLocation>;
+  auto& properties = scratch.mProperties;
+  properties.clear();
+  for (const auto& rule : scratch.mRules) {
+    const auto& layer = *rule.mpLayer;
+    const auto& body = layer.body(rule.mBody);
+
+    for (auto i = body.mFirstProperty; i < body.mFirstProperty + body.mPropertyCount;
+         ++i) {
+      const auto& propdef = layer.property(i);
+      properties.emplace_back(
+        orderKey(rule.mSpecificity, layer.index(), propdef.mByteOfs),
+        layer.propertyAtom(i), &layer, &propdef);
+    }
+  }
 
-template <typename Pred>
-void mergePropertiesIntoPropertyMap(PropertyMap& dest,
-                                    const PropertyDefMap& defs,
-                                    SourceLocationMap& locationMap,
-                                    Pred isPropLessSpecificPred)
-{
-  for (auto const& propdef : defs) {
-    auto foundIt = locationMap.find(propdef.first);
-    if (foundIt == locationMap.end()
-        || isPropLessSpecificPred(foundIt->second, propdef.second.mSourceLoc)) {
-      dest[QString::fromStdString(propdef.first)] = propdef.second;
-      locationMap[propdef.first] = propdef.second.mSourceLoc;
+  std::sort(properties.begin(), properties.end(),
+            [](const MatchedProperty& lhs, const MatchedProperty& rhs) {
+              return std::tie(lhs.mName, lhs.mOrderKey)
+                     < std::tie(rhs.mName, rhs.mOrderKey);
+            });
+
+  // keep the last, i.e. winning, definition of each property
+  auto out = properties.begin();
+  for (auto it = properties.begin(); it != properties.end(); ++it) {
+    const auto next = std::next(it);
+    if (next == properties.end() || next->mName != it->mName) {
+      *out++ = *it;
     }
   }
+  properties.erase(out, properties.end());
+
+  return properties.size();
 }
 
-PropertyMap mergeMatchResults(const MatchResult& result)
+PropertyValues loadPropertyValues(const StyleSheetImage& image,
+                                  const image::PropertyDef& propdef);
+
+PropertyMap makePropertyMap(const MatchScratch& scratch)
 {
   PropertyMap props;
-  SourceLocationMap locationMap;
-  Specificity lastSpec;
+  for (const auto& property : scratch.mProperties) {
+    const auto& layer = *property.mpLayer;
+    props.emplace(QString::fromStdString(atomName(property.mName)),
+                  Property(SourceLocation(layer.index(), int(property.mpDef->mByteOfs)),
+                           loadPropertyValues(layer.image(), *property.mpDef)));
+  }
+
+  return props;
+}
 
-  for (const auto& tup : result) {
-    BOOST_ASSERT(lastSpec < getMatchSpecificity(tup)
-                 || lastSpec == getMatchSpecificity(tup));
 
-    mergePropertiesIntoPropertyMap(
-      props, getMatchProperties(tup), locationMap,
-      [&lastSpec, &tup](const SourceLocation& one, const SourceLocation& two) {
-        return lastSpec != getMatchSpecificity(tup) || one < two;
-      });
-    lastSpec = getMatchSpecificity(tup);
+PropertyValues loadPropertyValues(const StyleSheetImage& image,
+                                  const image::PropertyDef& propdef)
+{
+  PropertyValues values;
+  values.reserve(propdef.mValueCount);
+
+  const auto* pValues = image.values(propdef);
+  for (std::uint32_t i = 0; i < propdef.mValueCount; ++i) {
+    const auto& value = pValues[i];
+    if (value.mKind == image::kExpression) {
+      Expression expr;
+      expr.name = image.string(value.mString).to_string();
+      const auto* pArgs = image.args(value);
+      for (std::uint32_t a = 0; a < value.mArgCount; ++a) {
+        expr.args.emplace_back(image.string(pArgs[a]).to_string());
+      }
+      values.emplace_back(std::move(expr));
+    } else {
+      values.emplace_back(image.string(value.mString).to_string());
+    }
   }
 
-  return props;
+  return values;
 }
 
-std::ostream& operator<<(std::ostream& os, const SourceLocation& srcloc)
+void dumpSourceLocation(const StyleSheetImage& image,
+                        const SourceLocation& srcloc,
+                        std::ostream& os)
 {
   std::string sourceLayerName =
     srcloc.mSourceLayer == 0 ? "default stylesheet" : "user stylesheet";
-  os << sourceLayerName << " at line " << srcloc.mLine << " column " << srcloc.mColumn;
-  return os;
+  os << sourceLayerName << " at line " << image.line(srcloc.mByteOfs) << " column "
+     << image.column(srcloc.mByteOfs);
 }
 
 std::ostream& operator<<(std::ostream& os, const PropertyValues& values)
@@ -568,49 +1378,136 @@ std::ostream& operator<<(std::ostream& os, const PropertyValues& values)
   return os;
 }
 
-void dumpPropertyDefMap(const PropertyDefMap& properties,
-                        std::ostream& stream = std::cout)
+void dumpMatchedProperties(const MatchedRule& rule, std::ostream& stream = std::cout)
 {
+  const auto& image = rule.mpLayer->image();
+  const auto& body = rule.mpLayer->body(rule.mBody);
+
   stream << "{" << std::endl;
-  for (const auto& it : properties) {
-    stream << "  " << it.first << ": " << it.second.mValues << " //"
-           << it.second.mSourceLoc << std::endl;
+  for (std::uint32_t i = 0; i < body.mPropertyCount; ++i) {
+    const auto& propdef = image.property(body.mFirstProperty + i);
+    stream << "  " << image.string(propdef.mName) << ": "
+           << loadPropertyValues(image, propdef) << " //";
+    dumpSourceLocation(
+      image, SourceLocation(rule.mpLayer->index(), int(propdef.mByteOfs)), stream);
+    stream << std::endl;
   }
   stream << "}" << std::endl;
 }
 
-void dumpMatchResults(const MatchResult& result, std::ostream& stream = std::cout)
+void dumpMatchResults(const std::vector<MatchedRule>& rules,
+                      std::ostream& stream = std::cout)
 {
-  for (const auto& tup : result) {
-    stream << "// specificity: " << getMatchSpecificity(tup) << std::endl;
-    dumpPropertyDefMap(getMatchProperties(tup), stream);
+  for (const auto& rule : rules) {
+    stream << "// specificity: " << rule.mSpecificity << std::endl;
+    dumpMatchedProperties(rule, stream);
   }
 }
 
+/*! Indicates whether @p lhs and @p rhs define the same values
+ *
+ * The byte offsets are ignored since editing one rule moves all rules after
+ * it.  The layer is not, because relative urls are resolved against the
+ * layer's style sheet. */
+bool isSameProperty(const Property& lhs, const Property& rhs)
+{
+  return lhs.mSourceLoc.mSourceLayer == rhs.mSourceLoc.mSourceLayer
+         && lhs.mValues == rhs.mValues;
+}
+
 } // anon namespace
 
+IMatchScratch::~IMatchScratch()
+{
+}
+
+std::unique_ptr<IMatchScratch> createMatchScratch()
+{
+  return estd::make_unique<MatchScratch>();
+}
+
 std::string describeMatchedPath(const IStyleMatchTree* itree, const UiItemPath& path)
 {
   const StyleMatchTree& tree = *static_cast<const StyleMatchTree*>(itree);
 
-  MatchResult result = findMatchingRules(tree, path);
-  sortMatchResults(result);
-  std::reverse(result.begin(), result.end());
+  MatchScratch scratch;
+  scratch.startMatch(tree, path);
+  findMatchingRules(tree, scratch);
+  auto& rules = scratch.mRules;
+
+  // most specific rules first
+  std::sort(rules.begin(), rules.end(),
+            [](const MatchedRule& lhs, const MatchedRule& rhs) {
+              return std::make_tuple(rhs.mSpecificity.mClass, rhs.mSpecificity.mElements,
+                                     rhs.mpLayer->index(), rhs.mBody)
+                     < std::make_tuple(lhs.mSpecificity.mClass,
+                                       lhs.mSpecificity.mElements,
+                                       lhs.mpLayer->index(), lhs.mBody);
+            });
 
   std::ostringstream stream;
   stream << "Style info for path " << path << std::endl;
-  dumpMatchResults(result, stream);
+  dumpMatchResults(rules, stream);
 
   return stream.str();
 }
 
-PropertyMap matchPath(const IStyleMatchTree* itree, const UiItemPath& path)
+std::size_t findMatchingProperties(const IStyleMatchTree* itree,
+                                   const UiItemPath& path,
+                                   IMatchScratch* iscratch)
 {
   const StyleMatchTree& tree = *static_cast<const StyleMatchTree*>(itree);
+  MatchScratch& scratch = *static_cast<MatchScratch*>(iscratch);
+
+  scratch.startMatch(tree, path);
+  findMatchingRules(tree, scratch);
+  return resolveProperties(scratch);
+}
+
+PropertyMap matchPath(const IStyleMatchTree* tree,
+                      const UiItemPath& path,
+                      IMatchScratch* iscratch)
+{
+  findMatchingProperties(tree, path, iscratch);
+  return makePropertyMap(*static_cast<MatchScratch*>(iscratch));
+}
 
-  MatchResult result = findMatchingRules(tree, path);
-  sortMatchResults(result);
-  return mergeMatchResults(result);
+PropertyMap matchPath(const IStyleMatchTree* tree, const UiItemPath& path)
+{
+  MatchScratch scratch;
+  return matchPath(tree, path, &scratch);
+}
+
+IMatchState::~IMatchState()
+{
+}
+
+std::shared_ptr<const IMatchState> createMatchState(const IStyleMatchTree* tree)
+{
+  return std::make_shared<MatchState>(static_cast<const StyleMatchTree*>(tree));
+}
+
+std::shared_ptr<const IMatchState> extendMatchState(
+  const std::shared_ptr<const IMatchState>& parent, const PathElement& element)
+{
+  return std::make_shared<MatchState>(
+    std::static_pointer_cast<const MatchState>(parent), element);
+}
+
+std::size_t findMatchingProperties(const IMatchState* istate, IMatchScratch* iscratch)
+{
+  const MatchState& state = *static_cast<const MatchState*>(istate);
+  MatchScratch& scratch = *static_cast<MatchScratch*>(iscratch);
+
+  scratch.startMatch(state);
+  findMatchingRules(state.tree(), scratch);
+  return resolveProperties(scratch);
+}
+
+PropertyMap matchPath(const IMatchState* state, IMatchScratch* iscratch)
+{
+  findMatchingProperties(state, iscratch);
+  return makePropertyMap(*static_cast<MatchScratch*>(iscratch));
 }
 
 std::ostream& operator<<(std::ostream& os, const UiItemPath& path)
@@ -629,39 +1526,71 @@ std::string pathToString(const UiItemPath& path)
       isFirst = false;
     }
 
-    ss << p.mTypeName;
+    ss << atomName(p.mTypeName);
+
+    // pseudo-states follow the class names
+    std::vector<AtomId> classNames;
+    std::vector<AtomId> states;
+    for (const auto cn : p.mClassNames) {
+      (isPseudoStateAtom(cn) ? states : classNames).push_back(cn);
+    }
 
-    if (!p.mClassNames.empty()) {
+    if (!classNames.empty()) {
       ss << ".";
     }
 
-    if (p.mClassNames.size() > 1) {
+    if (classNames.size() > 1) {
       ss << "{";
     }
 
     bool isFirstClass = true;
-    for (const auto& cn : p.mClassNames) {
+    for (const auto cn : classNames) {
       if (!isFirstClass) {
         ss << ",";
       } else {
         isFirstClass = false;
       }
-      ss << cn;
+      ss << atomName(cn);
     }
 
-    if (p.mClassNames.size() > 1) {
+    if (classNames.size() > 1) {
       ss << "}";
     }
+
+    for (const auto state : states) {
+      ss << atomName(state);
+    }
   }
 
   return ss.str();
 }
 
+PathElement::PathElement(const std::string& typeName,
+                         const std::vector<std::string>& classNames)
+  : mTypeName(internAtom(typeName))
+{
+  mClassNames.reserve(classNames.size());
+  for (const auto& className : classNames) {
+    mClassNames.push_back(internAtom(className));
+  }
+}
+
+PseudoStateMask pseudoStateBit(const std::string& state)
+{
+  return pseudoStateTable().bit(state);
+}
+
+void appendPseudoStates(std::vector<AtomId>& classNames, PseudoStateMask states)
+{
+  if (states != 0) {
+    pseudoStateTable().append(classNames, states);
+  }
+}
+
 std::size_t hash_value(const PathElement& pathElement)
 {
-  std::size_t seed = boost::hash<std::string>{}(pathElement.mTypeName);
-  boost::hash_combine(
-    seed, boost::hash<std::vector<std::string>>{}(pathElement.mClassNames));
+  std::size_t seed = boost::hash<AtomId>{}(pathElement.mTypeName);
+  boost::hash_combine(seed, boost::hash<std::vector<AtomId>>{}(pathElement.mClassNames));
   return seed;
 }
 
@@ -670,5 +1599,31 @@ std::size_t UiItemPathHasher::operator()(const UiItemPath& path) const
   return boost::hash<UiItemPath>{}(path);
 }
 
+QStringList changedPropertyKeys(const PropertyMap& oldProps, const PropertyMap& newProps)
+{
+  QStringList keys;
+
+  auto oldIt = oldProps.begin();
+  auto newIt = newProps.begin();
+  while (oldIt != oldProps.end() || newIt != newProps.end()) {
+    if (newIt == newProps.end()
+        || (oldIt != oldProps.end() && oldIt->first < newIt->first)) {
+      keys.append(oldIt->first);
+      ++oldIt;
+    } else if (oldIt == oldProps.end() || newIt->first < oldIt->first) {
+      keys.append(newIt->first);
+      ++newIt;
+    } else {
+      if (!isSameProperty(oldIt->second, newIt->second)) {
+        keys.append(newIt->first);
+      }
+      ++oldIt;
+      ++newIt;
+    }
+  }
+
+  return keys;
+}
+
 } // namespace stylesheets
 } // namespace aqt
@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 #pragma once
 
+#include "Atom.hpp"
 #include "Property.hpp"
 #include "CssParser.hpp"
 
@@ -29,9 +30,11 @@ THE SOFTWARE.
 
 SUPPRESS_WARNINGS
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QVariant>
 RESTORE_WARNINGS
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
@@ -47,9 +50,11 @@ class PathElement
 {
 public:
   PathElement(const std::string& typeName,
-              const std::vector<std::string>& classNames = {})
+              const std::vector<std::string>& classNames = {});
+
+  PathElement(AtomId typeName, std::vector<AtomId> classNames = {})
     : mTypeName(typeName)
-    , mClassNames(classNames)
+    , mClassNames(std::move(classNames))
   {
   }
 
@@ -63,12 +68,31 @@ class PathElement
     return !(*this == other);
   }
 
-  std::string mTypeName;
-  std::vector<std::string> mClassNames;
+  AtomId mTypeName;
+  std::vector<AtomId> mClassNames;
 };
 
 std::size_t hash_value(const PathElement& pathElement);
 
+/*! A set of pseudo-states like ":hover", one bit per state */
+using PseudoStateMask = std::uint32_t;
+
+/*! Returns the bit of the pseudo-state @p state, given without the colon
+ *
+ * "hover", "pressed", "focus" and "disabled" have fixed bits, custom states
+ * get the next free bit when first seen.  Returns 0 if all bits are taken.
+ */
+PseudoStateMask pseudoStateBit(const std::string& state);
+
+/*! Appends the atoms of the pseudo-states in @p states to @p classNames
+ *
+ * Pseudo-states are matched like class names.  Their atoms keep the leading
+ * colon, so the selector ":hover" never matches the class ".hover".  The
+ * atoms are appended in bit order, which makes a set of states always yield
+ * the same path element.
+ */
+void appendPseudoStates(std::vector<AtomId>& classNames, PseudoStateMask states);
+
 using UiItemPath = std::vector<PathElement>;
 
 struct UiItemPathHasher {
@@ -80,14 +104,101 @@ std::string pathToString(const UiItemPath& path);
 
 using PropertyMap = std::map<QString, Property>;
 
+/*! Returns the keys added, removed or changed from @p oldProps to @p newProps
+ *
+ * A property counts as changed if its values or the layer defining it
+ * differ.  Moving a rule within its style sheet doesn't change it. */
+QStringList changedPropertyKeys(const PropertyMap& oldProps, const PropertyMap& newProps);
+
+class StyleSheetImage;
+
 class IStyleMatchTree
 {
+public:
+  virtual ~IStyleMatchTree();
 };
 
+/*! Compiles the match tree for @p stylesheet into a binary image
+ *
+ * The image can be written to a file and loaded later
+ * with StyleSheetImage::load(), which skips parsing and tree building. */
+std::shared_ptr<const StyleSheetImage> compileStyleSheet(const StyleSheet& stylesheet);
+
 std::unique_ptr<IStyleMatchTree> createMatchTree(
   const StyleSheet& stylesheet, const StyleSheet& defaultStylesheet = StyleSheet());
 
+/*! Creates a match tree from compiled style sheets
+ *
+ * Either of the arguments can be null, which is equivalent to an empty
+ * style sheet. */
+std::unique_ptr<IStyleMatchTree> createMatchTree(
+  std::shared_ptr<const StyleSheetImage> stylesheet,
+  std::shared_ptr<const StyleSheetImage> defaultStylesheet);
+
+/*! Reusable working memory for matching paths
+ *
+ * Matching keeps all intermediate results in the scratch buffer.  A caller
+ * (or thread) reusing one instance for consecutive calls avoids any heap
+ * allocation once the buffer has grown to the needed size.  A scratch
+ * buffer must not be used by more than one thread at a time.
+ */
+class IMatchScratch
+{
+public:
+  virtual ~IMatchScratch();
+};
+
+std::unique_ptr<IMatchScratch> createMatchScratch();
+
+/*! Finds the effective property definitions for @p path
+ *
+ * The definitions are kept in @p scratch until its next use.  Returns the
+ * number of effective properties.  This does not allocate memory once
+ * @p scratch has grown to the needed size. */
+std::size_t findMatchingProperties(const IStyleMatchTree* tree,
+                                   const UiItemPath& path,
+                                   IMatchScratch* scratch);
+
+/*! Returns the effective properties for @p path
+ *
+ * The only allocations done are those for building the returned map. */
+PropertyMap matchPath(const IStyleMatchTree* tree,
+                      const UiItemPath& path,
+                      IMatchScratch* scratch);
 PropertyMap matchPath(const IStyleMatchTree* tree, const UiItemPath& path);
+
+/*! The resumable state of matching a path
+ *
+ * A state holds a path prefix together with the ancestor filter the
+ * matching kernel needs for it, both taken over from the parent's state.
+ * Extending a state by one element therefore only looks at that element,
+ * and matching it runs the kernel of findMatchingProperties() without
+ * rebuilding the path.  States are immutable and can be shared by several
+ * threads.  They refer to the tree they have been created for and must not
+ * outlive it.
+ */
+class IMatchState
+{
+public:
+  virtual ~IMatchState();
+};
+
+//! Returns the state of matching the empty path against @p tree
+std::shared_ptr<const IMatchState> createMatchState(const IStyleMatchTree* tree);
+
+//! Returns the state of the path of @p parent extended by @p element
+std::shared_ptr<const IMatchState> extendMatchState(
+  const std::shared_ptr<const IMatchState>& parent, const PathElement& element);
+
+/*! Finds the effective property definitions for the path of @p state
+ *
+ * Like findMatchingProperties() for a path this does not allocate memory
+ * once @p scratch has grown to the needed size. */
+std::size_t findMatchingProperties(const IMatchState* state, IMatchScratch* scratch);
+
+//! Returns the effective properties for the path of @p state
+PropertyMap matchPath(const IMatchState* state, IMatchScratch* scratch);
+
 std::string describeMatchedPath(const IStyleMatchTree* tree, const UiItemPath& path);
 
 } // namespace stylesheets
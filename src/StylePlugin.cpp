@@ -43,6 +43,7 @@ void aqt::stylesheets::StylePlugin::registerTypes(const char* pUri)
     pUri, 1, 2, "StyleSetProps", "Exposed as StyleSet.props");
   qmlRegisterType<aqt::stylesheets::StyleEngine>(pUri, 1, 0, "StyleEngine");
   qmlRegisterType<aqt::stylesheets::StyleEngine, 1>(pUri, 1, 1, "StyleEngine");
+  qmlRegisterType<aqt::stylesheets::StyleEngine, 2>(pUri, 1, 2, "StyleEngine");
   qmlRegisterType<aqt::stylesheets::StylesDirWatcher>(pUri, 1, 1, "StylesDirWatcher");
 }
 
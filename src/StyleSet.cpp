@@ -22,15 +22,20 @@ THE SOFTWARE.
 
 #include "StyleSet.hpp"
 
+#include "Convert.hpp"
 #include "Log.hpp"
 #include "StyleEngine.hpp"
 #include "Warnings.hpp"
 
 SUPPRESS_WARNINGS
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
 #include <QtQuick/QQuickItem>
 RESTORE_WARNINGS
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 namespace aqt
 {
@@ -54,75 +59,76 @@ const std::string normalizeTypename(const std::string& tynm)
   return tynm;
 }
 
-std::string typeName(QObject* obj)
+//! Returns the atom of the normalized type name of @p pObj
+AtomId typeName(QObject* pObj)
 {
-  if (obj) {
-    const QMetaObject* meta = obj->metaObject();
-    return normalizeTypename(meta->className());
+  // Keyed by class name rather than by meta object, since the meta objects of
+  // QML types are freed and their addresses reused when components are
+  // unloaded.  StyleSets are only created in the GUI thread.
+  static QHash<QByteArray, AtomId> sTypeNames;
+
+  const char* className = pObj->metaObject()->className();
+  const auto key = QByteArray::fromRawData(className, int(qstrlen(className)));
+  const auto it = sTypeNames.constFind(key);
+  if (it != sTypeNames.constEnd()) {
+    return it.value();
   }
-  return "(null)";
+
+  // the raw key only borrows the meta object's string, so a copy is stored
+  const auto atom = internAtom(normalizeTypename(className));
+  sTypeNames.insert(QByteArray(className), atom);
+  return atom;
 }
 
-std::vector<std::string> styleClassName(QObject* pObj)
+std::vector<AtomId> splitClassNames(const QString& name)
 {
-  StyleSet* pStyleSet =
-    qobject_cast<StyleSet*>(qmlAttachedPropertiesObject<StyleSet>(pObj, false));
-
-  std::vector<std::string> classNames;
-
-  if (pStyleSet) {
-    for (auto className : pStyleSet->name().split(" ")) {
-      classNames.emplace_back(className.toStdString());
-    }
+  std::vector<AtomId> classNames;
+  for (auto className : name.split(" ")) {
+    classNames.emplace_back(internAtom(className.toStdString()));
   }
-
   return classNames;
 }
 
-template <typename T, typename ObjVisitor>
-T traverseParentChain(QObject* pObj, ObjVisitor visitor)
+StyleSet* attachedStyleSet(QObject* pObj)
 {
-  QObject* p = pObj;
-  while (p) {
-    if (visitor(p)) {
-      QObject* nextp = p->parent();
-      if (!nextp) {
-        if (QQuickItem* pItem = qobject_cast<QQuickItem*>(p)) {
-          if (QQuickItem* pParentItem = pItem->parentItem()) {
-            nextp = pParentItem;
-          }
-        }
-      }
-      p = nextp;
-    } else {
-      p = nullptr;
+  return qobject_cast<StyleSet*>(qmlAttachedPropertiesObject<StyleSet>(pObj, false));
+}
+
+QObject* parentObject(QObject* pObj)
+{
+  QObject* pParent = pObj->parent();
+  if (!pParent) {
+    if (QQuickItem* pItem = qobject_cast<QQuickItem*>(pObj)) {
+      pParent = pItem->parentItem();
     }
   }
-
-  return visitor.result();
+  return pParent;
 }
 
-class CollectPathVisitor
+//! Calls @p visit for each object whose parentObject() is @p pObj
+template <typename Visitor>
+void forEachChildObject(QObject* pObj, Visitor visit)
 {
-public:
-  UiItemPath mResult;
-
-  bool operator()(QObject* pObj)
-  {
-    mResult.emplace_back(typeName(pObj), styleClassName(pObj));
-    return true;
+  for (QObject* pChild : pObj->children()) {
+    visit(pChild);
   }
-
-  UiItemPath result() const
-  {
-    return {mResult.rbegin(), mResult.rend()};
+  if (QQuickItem* pItem = qobject_cast<QQuickItem*>(pObj)) {
+    for (QQuickItem* pChild : pItem->childItems()) {
+      // items with an object parent have been visited as its children
+      if (!pChild->parent()) {
+        visit(pChild);
+      }
+    }
   }
-};
+}
 
-UiItemPath traversePathUp(QObject* pObj)
+//! Returns the values of @p prop as returned by StyleSetProps::values()
+QVariant propertyValue(const Property& prop)
 {
-  CollectPathVisitor collectPathVisitor;
-  return traverseParentChain<UiItemPath>(pObj, collectPathVisitor);
+  if (prop.mValues.size() == 1) {
+    return convertValueToVariant(prop.mValues[0]);
+  }
+  return convertValueToVariantList(prop.mValues);
 }
 
 } // anon namespace
@@ -130,15 +136,18 @@ UiItemPath traversePathUp(QObject* pObj)
 StyleSet::StyleSet(QObject* pParent)
   : QObject(pParent)
   , mpStyleSetProps(StyleSetProps::nullStyleSetProps())
+  , mClassNames(splitClassNames(mName))
+  , mStates(0)
+  , mpPath(nullptr)
+  , mpBase(nullptr)
+  , mpValues(nullptr)
+  , mIsPropsRead(false)
 {
   auto* pEngine = StyleEngineHost::globalStyleEngine();
 
   QObject* p = parent();
   if (p) {
-    QQuickItem* pItem = qobject_cast<QQuickItem*>(p);
-    if (pItem != nullptr) {
-      connect(pItem, &QQuickItem::parentChanged, this, &StyleSet::onParentChanged);
-    } else if (p->parent() != nullptr) {
+    if (qobject_cast<QQuickItem*>(p) == nullptr && p->parent() != nullptr) {
       styleSheetsLogInfo() << "Parent to StyleSet is not a QQuickItem but '"
                            << p->metaObject()->className() << "'. "
                            << "Hierarchy changes for this component won't be detected.";
@@ -150,14 +159,23 @@ StyleSet::StyleSet(QObject* pParent)
       }
     }
 
-    mPath = traversePathUp(p);
-
     if (!pEngine) {
       connect(StyleEngineHost::globalStyleEngineHost(),
               &StyleEngineHost::styleEngineLoaded, this, &StyleSet::onStyleEngineLoaded);
     }
 
-    setupStyle();
+    updatePath();
+    takeOverDependents(p);
+  }
+}
+
+StyleSet::~StyleSet()
+{
+  releaseStyleSetProps(mpStyleSetProps);
+
+  setBase(nullptr);
+  for (auto* pDependent : mDependents) {
+    pDependent->mpBase = nullptr;
   }
 }
 
@@ -181,13 +199,39 @@ void StyleSet::onStyleEngineLoaded(StyleEngine* pEngine)
 void StyleSet::setupStyle()
 {
   if (auto* pEngine = StyleEngineHost::globalStyleEngine()) {
-    mpStyleSetProps = pEngine->styleSetProps(mPath);
+    auto* pOldStyleSetProps = mpStyleSetProps;
+    pOldStyleSetProps->disconnect(this);
+    mpStyleSetProps = pEngine->acquireStyleSetProps(mpPath);
 
-    connect(mpStyleSetProps, &StyleSetProps::propsChanged, this, &StyleSet::propsChanged);
+    connect(
+      mpStyleSetProps, &StyleSetProps::propsChanged, this, &StyleSet::onPropsChanged);
+    connect(mpStyleSetProps, &StyleSetProps::propertiesChanged, this,
+            &StyleSet::onPropertiesChanged);
     connect(
       mpStyleSetProps, &StyleSetProps::invalidated, this, &StyleSet::onPropsInvalidated);
 
-    Q_EMIT propsChanged();
+    // comparing the props resolves them, which isn't needed as long as
+    // nobody has read them
+    QStringList keys;
+    if (mpValues || mIsPropsRead) {
+      keys = changedPropertyKeys(pOldStyleSetProps->properties(),
+                                 mpStyleSetProps->properties());
+    }
+    if (mpValues) {
+      updateValues(keys);
+    }
+    releaseStyleSetProps(pOldStyleSetProps);
+
+    if (!keys.isEmpty()) {
+      Q_EMIT propsChanged();
+    }
+  }
+}
+
+void StyleSet::releaseStyleSetProps(StyleSetProps* pStyleSetProps)
+{
+  if (auto* pEngine = pStyleSetProps->engine()) {
+    pEngine->releaseStyleSetProps(pStyleSetProps);
   }
 }
 
@@ -200,44 +244,253 @@ void StyleSet::setName(const QString& val)
 {
   if (mName != val) {
     mName = val;
+    mClassNames = splitClassNames(mName);
 
-    QObject* p = parent();
-    if (p) {
-      mPath = traversePathUp(p);
-      setupStyle();
+    if (parent()) {
+      updatePath();
     }
 
     Q_EMIT nameChanged(mName);
-    Q_EMIT pathChanged();
   }
 }
 
+void StyleSet::setClass(const QString& className, bool enabled)
+{
+  // names never interned can't be set, so removing them needs no atom
+  const auto atom = enabled ? internAtom(className.toStdString())
+                            : findAtom(className.toStdString());
+  auto it = std::find(mClassNames.begin(), mClassNames.end(), atom);
+  if ((it != mClassNames.end()) == enabled) {
+    return;
+  }
+
+  if (enabled) {
+    if (mName.isEmpty()) {
+      mClassNames.clear();
+      mName = className;
+    } else {
+      mName += QLatin1Char(' ') + className;
+    }
+    mClassNames.emplace_back(atom);
+  } else {
+    auto names = mName.split(QLatin1Char(' '));
+    names.removeAll(className);
+    mName = names.join(QLatin1Char(' '));
+
+    mClassNames.erase(it);
+    if (mClassNames.empty()) {
+      mClassNames.emplace_back(internAtom(std::string()));
+    }
+  }
+
+  if (!mElements.empty()) {
+    mElements.back().mClassNames = classNames();
+    applyPath();
+  }
+
+  Q_EMIT nameChanged(mName);
+}
+
+void StyleSet::setState(const QString& state, bool enabled)
+{
+  const auto bit = pseudoStateBit(state.toStdString());
+  if (bit == 0) {
+    styleSheetsLogWarning() << "Too many pseudo-states, ignoring ':"
+                            << state.toStdString() << "'";
+    return;
+  }
+
+  const auto states = enabled ? mStates | bit : mStates & ~bit;
+  if (states != mStates) {
+    mStates = states;
+
+    if (!mElements.empty()) {
+      mElements.back().mClassNames = classNames();
+      applyPath();
+    }
+  }
+}
+
+bool StyleSet::hasState(const QString& state) const
+{
+  return (mStates & pseudoStateBit(state.toStdString())) != 0;
+}
+
+bool StyleSet::hasClass(const QString& className) const
+{
+  // kNoAtom for names never interned, which no StyleSet can have
+  const auto atom = findAtom(className.toStdString());
+  return std::find(mClassNames.begin(), mClassNames.end(), atom) != mClassNames.end();
+}
+
+std::vector<AtomId> StyleSet::classNames() const
+{
+  auto classNames = mClassNames;
+  appendPseudoStates(classNames, mStates);
+  return classNames;
+}
+
+const PathNode* StyleSet::pathNode() const
+{
+  return mpPath;
+}
+
 QString StyleSet::path() const
 {
-  return QString::fromStdString(pathToString(mPath));
+  return QString::fromStdString(pathToString(mpPath));
 }
 
 QString StyleSet::styleInfo() const
 {
   auto* pEngine = StyleEngineHost::globalStyleEngine();
-  std::string styleInfoStr(pEngine ? pEngine->describeMatchedPath(mPath)
+  std::string styleInfoStr(pEngine ? pEngine->describeMatchedPath(mpPath)
                                    : "No style engine installed");
   return QString::fromStdString(styleInfoStr);
 }
 
 StyleSetProps* StyleSet::props()
 {
+  mIsPropsRead = true;
   return mpStyleSetProps;
 }
 
 void StyleSet::onParentChanged(QQuickItem* pNewParent)
 {
-  QObject* pParent = parent();
-  if (pNewParent != nullptr && pParent != nullptr) {
-    mPath = traversePathUp(pParent);
+  if (pNewParent != nullptr && parent() != nullptr) {
+    updatePath();
+  }
+}
+
+void StyleSet::updatePath()
+{
+  for (const auto& connection : mChainConnections) {
+    disconnect(connection);
+  }
+  mChainConnections.clear();
+  mElements.clear();
+
+  // Walk up to the nearest ancestor carrying a StyleSet, whose path is reused.  The
+  // items passed on the way are watched since moving any of them changes our path.
+  StyleSet* pBase = nullptr;
+  QObject* pObj = parent();
+  for (QObject* p = pObj; p; p = parentObject(p)) {
+    auto* pStyleSet = attachedStyleSet(p);
+    if (p != pObj && pStyleSet && pStyleSet->pathNode()) {
+      pBase = pStyleSet;
+      break;
+    }
+    mElements.emplace_back(
+      typeName(p), pStyleSet ? pStyleSet->classNames() : std::vector<AtomId>());
+
+    if (QQuickItem* pItem = qobject_cast<QQuickItem*>(p)) {
+      mChainConnections.emplace_back(
+        connect(pItem, &QQuickItem::parentChanged, this, &StyleSet::onParentChanged));
+    }
+  }
+  std::reverse(mElements.begin(), mElements.end());
+
+  setBase(pBase);
+  applyPath();
+}
+
+void StyleSet::takeOverDependents(QObject* pObj)
+{
+  forEachChildObject(pObj, [this](QObject* pChild) {
+    if (auto* pStyleSet = attachedStyleSet(pChild)) {
+      // the StyleSets below pStyleSet follow it when its path changes
+      if (pStyleSet->mpBase != this) {
+        pStyleSet->updatePath();
+      }
+    } else if (pChild != this) {
+      takeOverDependents(pChild);
+    }
+  });
+}
+
+void StyleSet::setBase(StyleSet* pBase)
+{
+  if (mpBase != pBase) {
+    if (mpBase) {
+      auto& dependents = mpBase->mDependents;
+      dependents.erase(std::find(dependents.begin(), dependents.end(), this));
+    }
+    mpBase = pBase;
+    if (mpBase) {
+      mpBase->mDependents.emplace_back(this);
+    }
+  }
+}
+
+void StyleSet::applyPath()
+{
+  const PathNode* pPath = mpBase ? mpBase->pathNode() : nullptr;
+  for (const auto& element : mElements) {
+    pPath = internPath(pPath, element);
+  }
+
+  if (pPath != mpPath) {
+    mpPath = pPath;
     setupStyle();
 
     Q_EMIT pathChanged();
+
+    // Push the new prefix down.  The dependents' match states are resumed from ours,
+    // which setupStyle() has just resolved.
+    for (std::size_t i = 0; i < mDependents.size(); ++i) {
+      mDependents[i]->applyPath();
+    }
+  }
+}
+
+QQmlPropertyMap* StyleSet::values()
+{
+  if (!mpValues) {
+    mpValues = new QQmlPropertyMap(this);
+
+    QStringList keys;
+    for (const auto& property : mpStyleSetProps->properties()) {
+      keys.append(property.first);
+    }
+    updateValues(keys);
+  }
+
+  return mpValues;
+}
+
+void StyleSet::updateValues(const QStringList& keys)
+{
+  const auto& properties = mpStyleSetProps->properties();
+  for (const auto& key : keys) {
+    const auto it = properties.find(key);
+    if (it != properties.end()) {
+      mpValues->insert(key, propertyValue(it->second));
+    } else if (mpValues->contains(key)) {
+      mpValues->clear(key);
+    }
+  }
+}
+
+void StyleSet::onPropsChanged()
+{
+  // stale props don't tell which keys have changed, so all values are
+  // looked up again
+  if (mpValues && mpStyleSetProps->isStale()) {
+    auto keys = mpValues->keys();
+    for (const auto& property : mpStyleSetProps->properties()) {
+      if (!mpValues->contains(property.first)) {
+        keys.append(property.first);
+      }
+    }
+    updateValues(keys);
+  }
+
+  Q_EMIT propsChanged();
+}
+
+void StyleSet::onPropertiesChanged(const QStringList& keys)
+{
+  if (mpValues) {
+    updateValues(keys);
   }
 }
 
@@ -245,6 +498,11 @@ void StyleSet::onPropsInvalidated()
 {
   mpStyleSetProps->disconnect(this);
   mpStyleSetProps = StyleSetProps::nullStyleSetProps();
+
+  if (mpValues) {
+    updateValues(mpValues->keys());
+  }
+
   Q_EMIT propsChanged();
 }
 
@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 #pragma once
 
+#include "PathNode.hpp"
 #include "StyleMatchTree.hpp"
 #include "StyleSetProps.hpp"
 #include "Warnings.hpp"
@@ -29,9 +30,12 @@ THE SOFTWARE.
 SUPPRESS_WARNINGS
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtQml/QQmlPropertyMap>
 #include <QtQml/qqml.h>
 RESTORE_WARNINGS
 
+#include <vector>
+
 class QQuickItem;
 
 namespace aqt
@@ -50,7 +54,9 @@ class StyleEngine;
  * a QML item it
  *
  *   - determines the path of the attached-to-item up to its very root (the root
- *     of the QQuickItem object hierarchy).
+ *     of the QQuickItem object hierarchy).  The path is extended from the
+ *     nearest ancestor's StyleSet and pushed down to the descendants' StyleSets
+ *     whenever it changes.
  *   - connects itself to the singleton styleEngine or its styleChanged signal resp.
  *   - determines its style properties by matching the attached-to item's element
  *     path against the selector rules loaded from the style sheet.
@@ -164,10 +170,33 @@ class StyleSet : public QObject
 
   Q_PROPERTY(QString styleInfo READ styleInfo NOTIFY propsChanged)
 
+  /*! @public Contains the style properties as a map of values
+   *
+   * Unlike a binding calling a function on props, which is re-evaluated
+   * whenever any property of the element changes, a binding reading a key
+   * of this map only depends on that key.  A style reload, a class or a
+   * state change thus re-evaluates just the bindings of the properties that
+   * actually changed.
+   *
+   * @par Example:
+   * @code
+   * Rectangle {
+   *   color: StyleSet.values["background-color"]
+   *   radius: StyleSet.values.radius
+   * }
+   * @endcode
+   *
+   * The values are converted like those returned by StyleSetProps::values().
+   * Undefined properties are @c undefined and, other than with props, do not
+   * report a warning.
+   */
+  Q_PROPERTY(QQmlPropertyMap* values READ values CONSTANT)
+
   /*! @cond DOXYGEN_IGNORE */
 
 public:
   explicit StyleSet(QObject* pParent = nullptr);
+  ~StyleSet();
 
   static StyleSet* qmlAttachedProperties(QObject* pObject);
 
@@ -177,10 +206,70 @@ class StyleSet : public QObject
   QString path() const;
   StyleSetProps* props();
 
+  //! the atoms of the style class names followed by those of the pseudo-states
+  std::vector<AtomId> classNames() const;
+  //! the interned path or nullptr if the StyleSet has no parent
+  const PathNode* pathNode() const;
+
   QString styleInfo() const;
+  QQmlPropertyMap* values();
 
 /*! @endcond */
 
+  /*! Adds or removes the style class @p className
+   *
+   * This is the cheap way to express states like "selected": unlike assigning
+   * a new name it neither splits the name nor walks up the item hierarchy, it
+   * only exchanges the item's own path element.  Paths seen before resolve to
+   * their cached properties, so toggling back and forth is a table lookup.
+   *
+   * @par Example:
+   * @code
+   * Rectangle {
+   *   StyleSet.name: "cell"
+   *   MouseArea {
+   *     anchors.fill: parent
+   *     hoverEnabled: true
+   *     onContainsMouseChanged: parent.StyleSet.setClass("hovered", containsMouse)
+   *   }
+   * }
+   * @endcode
+   *
+   * The name property is updated accordingly.
+   */
+  Q_INVOKABLE void setClass(const QString& className, bool enabled);
+
+  /*! Indicates whether the style class @p className is set */
+  Q_INVOKABLE bool hasClass(const QString& className) const;
+
+  /*! Sets or clears the pseudo-state @p state
+   *
+   * Pseudo-states are matched by selectors like @c :hover, @c :pressed,
+   * @c :focus and @c :disabled.  Any other name can be used as a custom
+   * state, which is then matched by the selector of the same name.  The
+   * properties of each combination of states are resolved once and cached,
+   * so that changing a state afterwards only switches to the cached
+   * properties.
+   *
+   * @par Example:
+   * @code
+   * Rectangle {
+   *   color: StyleSet.props.color("background")  // "Rectangle:hover" rules apply
+   *   MouseArea {
+   *     anchors.fill: parent
+   *     hoverEnabled: true
+   *     onContainsMouseChanged: parent.StyleSet.setState("hover", containsMouse)
+   *   }
+   * }
+   * @endcode
+   *
+   * Unlike class names states are not part of the name property.
+   */
+  Q_INVOKABLE void setState(const QString& state, bool enabled);
+
+  /*! Indicates whether the pseudo-state @p state is set */
+  Q_INVOKABLE bool hasState(const QString& state) const;
+
 Q_SIGNALS:
   /*! Fires when properties change
    *
@@ -204,14 +293,41 @@ private Q_SLOTS:
   void onStyleEngineLoaded(StyleEngine* pEngine);
   void onParentChanged(QQuickItem* pNewParent);
   void onPropsInvalidated();
+  void onPropsChanged();
+  void onPropertiesChanged(const QStringList& keys);
 
 private:
   void setupStyle();
+  void releaseStyleSetProps(StyleSetProps* pStyleSetProps);
+  void updatePath();
+  /*! Rebases the StyleSets below @p pObj which have been created before us
+   *
+   * They are still based on our base and lack our class names. */
+  void takeOverDependents(QObject* pObj);
+  void setBase(StyleSet* pBase);
+  void applyPath();
+  void updateValues(const QStringList& keys);
 
 private:
   StyleSetProps* mpStyleSetProps;
   QString mName;
-  UiItemPath mPath;
+  std::vector<AtomId> mClassNames;
+  PseudoStateMask mStates;
+  const PathNode* mpPath;
+
+  //! the nearest ancestor StyleSet our path is based on
+  StyleSet* mpBase;
+  //! the StyleSets based on this one
+  std::vector<StyleSet*> mDependents;
+  //! the path elements from below mpBase down to our item
+  std::vector<PathElement> mElements;
+  //! the parentChanged connections to the items of mElements
+  std::vector<QMetaObject::Connection> mChainConnections;
+
+  //! the values map, created on first use
+  QQmlPropertyMap* mpValues;
+  //! whether props() has been read, whose readers must learn about changes
+  bool mIsPropsRead;
 
   /*! @endcond */
 };
@@ -35,7 +35,7 @@ namespace stylesheets
 namespace
 {
 
-PropertyMap* nullProperties()
+const PropertyMap* nullProperties()
 {
   static PropertyMap sNullPropertyMap;
   return &sNullPropertyMap;
@@ -43,44 +43,51 @@ PropertyMap* nullProperties()
 
 } // anon namespace
 
-StyleSetProps::StyleSetProps(const UiItemPath& path, StyleEngine* pEngine)
+StyleSetProps::StyleSetProps(const PathNode* pPath, StyleEngine* pEngine)
   : mpEngine(pEngine)
-  , mPath(path)
+  , mpPath(pPath)
   , mpProperties(nullProperties())
+  , mGeneration(0)
+  , mIsObserved(false)
 {
-  loadProperties();
+  // in lazy mode the properties are resolved when they are first read
+  if (mpEngine && !mpEngine->lazyReload()) {
+    loadProperties();
+  }
 }
 
 StyleSetProps* StyleSetProps::nullStyleSetProps()
 {
-  static StyleSetProps sNullStyleSetProps{{}, nullptr};
+  static StyleSetProps sNullStyleSetProps{nullptr, nullptr};
   return &sNullStyleSetProps;
 }
 
 bool StyleSetProps::isValid() const
 {
-  return !mpProperties->empty();
+  return !properties().empty();
 }
 
 bool StyleSetProps::isSet(const QString& key) const
 {
-  return mpProperties->find(key) != mpProperties->end();
+  const auto& props = properties();
+  return props.find(key) != props.end();
 }
 
 bool StyleSetProps::getImpl(Property& prop, const QString& key) const
 {
-  PropertyMap::const_iterator it = mpProperties->find(key);
-  if (it != mpProperties->end()) {
+  const auto& props = properties();
+  PropertyMap::const_iterator it = props.find(key);
+  if (it != props.end()) {
     prop = it->second;
     return true;
   }
 
   if (mpEngine) {
     styleSheetsLogWarning() << "Property " << key.toStdString() << " not found ("
-                            << pathToString(mPath) << ")";
+                            << pathToString(mpPath) << ")";
     Q_EMIT mpEngine->exception(QString::fromLatin1("propertyNotFound"),
                                QString::fromLatin1("Property '%1' not found (%2)")
-                                 .arg(key, QString::fromStdString(pathToString(mPath))));
+                                 .arg(key, QString::fromStdString(pathToString(mpPath))));
   }
 
   return false;
@@ -161,15 +168,60 @@ QUrl StyleSetProps::url(const QString& key) const
 
   return url;
 }
+const PathNode* StyleSetProps::path() const
+{
+  return mpPath;
+}
+
+StyleEngine* StyleSetProps::engine() const
+{
+  return mpEngine;
+}
+
+const PropertyMap& StyleSetProps::properties() const
+{
+  if (mpEngine && mGeneration != mpEngine->generation()) {
+    mpProperties = mpEngine->properties(mpPath);
+    mGeneration = mpEngine->generation();
+  }
+  mIsObserved = true;
+  return *mpProperties;
+}
+
 void StyleSetProps::loadProperties()
 {
   if (mpEngine) {
-    mpProperties = mpEngine->properties(mPath);
-    Q_EMIT propsChanged();
+    auto* pOldProperties = mpProperties;
+    mpProperties = mpEngine->properties(mpPath);
+    mGeneration = mpEngine->generation();
+
+    const auto keys = mpProperties != pOldProperties
+                        ? changedPropertyKeys(*pOldProperties, *mpProperties)
+                        : QStringList();
+    if (!keys.isEmpty()) {
+      Q_EMIT propertiesChanged(keys);
+      Q_EMIT propsChanged();
+    }
   } else {
     mpProperties = nullProperties();
   }
 }
 
+bool StyleSetProps::isStale() const
+{
+  return mpEngine && mGeneration != mpEngine->generation();
+}
+
+void StyleSetProps::markStale()
+{
+  // the maps of the last generation are released after the reload
+  mpProperties = nullProperties();
+
+  if (mIsObserved) {
+    mIsObserved = false;
+    Q_EMIT propsChanged();
+  }
+}
+
 } // namespace stylesheets
 } // namespace aqt
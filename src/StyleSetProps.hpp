@@ -22,12 +22,14 @@ THE SOFTWARE.
 
 #pragma once
 
+#include "PathNode.hpp"
 #include "StyleMatchTree.hpp"
 #include "Warnings.hpp"
 
 SUPPRESS_WARNINGS
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
 #include <QtGui/QColor>
@@ -49,7 +51,7 @@ class StyleSetProps : public QObject
 
 public:
   /*! @cond DOXYGEN_IGNORE */
-  StyleSetProps(const UiItemPath& path, StyleEngine* pEngine);
+  StyleSetProps(const PathNode* pPath, StyleEngine* pEngine);
 
   static StyleSetProps* nullStyleSetProps();
   /*! @endcond */
@@ -267,10 +269,36 @@ class StyleSetProps : public QObject
   Q_REVISION(2) Q_INVOKABLE QUrl url(const QString& key) const;
 
   /*! @cond DOXYGEN_IGNORE */
+
+  //! the path the properties are resolved for
+  const PathNode* path() const;
+  //! the engine the properties are resolved by, nullptr for the null props
+  StyleEngine* engine() const;
+
+  //! the effective properties, resolved again if they are stale
+  const PropertyMap& properties() const;
+
+  /*! Resolves the properties again, e.g. after the style sheet changed
+   *
+   * The signals are only emitted if any property has actually been added,
+   * removed or changed its value. */
   void loadProperties();
 
+  //! whether the properties are resolved again when they are read next
+  bool isStale() const;
+
+  /*! Marks the properties stale after a lazy reload
+   *
+   * The properties are resolved again when they are read the next time.  If
+   * they have been read since they were resolved, propsChanged() is emitted
+   * so that their readers query them again; which keys have changed is not
+   * known until then, so propertiesChanged() is not. */
+  void markStale();
+
 Q_SIGNALS:
   void propsChanged();
+  //! Fires right before propsChanged() with the keys that have changed
+  void propertiesChanged(const QStringList& keys);
   void invalidated();
 
 private:
@@ -283,8 +311,12 @@ class StyleSetProps : public QObject
 
 private:
   StyleEngine* const mpEngine;
-  UiItemPath mPath;
-  PropertyMap* mpProperties;
+  const PathNode* mpPath;
+  mutable const PropertyMap* mpProperties;
+  //! the StyleEngine::generation() mpProperties have been resolved for
+  mutable unsigned int mGeneration;
+  //! whether anybody has read the properties, who must be told about changes
+  mutable bool mIsObserved;
   /*! @endcond */
 };
 
@@ -0,0 +1,327 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "StyleSheetImage.hpp"
+
+#include "CssParser.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+namespace
+{
+
+template <typename T>
+const T* sectionData(const char* pData, const image::Section& section)
+{
+  return reinterpret_cast<const T*>(pData + section.mOffset);
+}
+
+template <typename T>
+bool isValidSection(const image::Section& section, std::size_t size)
+{
+  return section.mOffset % alignof(std::uint32_t) == 0
+         && std::uint64_t(section.mOffset) + std::uint64_t(section.mCount) * sizeof(T)
+              <= size;
+}
+
+bool isValidRange(std::uint32_t first, std::uint32_t count, std::uint32_t size)
+{
+  return std::uint64_t(first) + count <= size;
+}
+
+template <typename T>
+void appendSection(std::vector<char>& buffer,
+                   image::Section& section,
+                   const T* pData,
+                   std::size_t count)
+{
+  buffer.resize((buffer.size() + alignof(std::uint32_t) - 1)
+                & ~(alignof(std::uint32_t) - 1));
+  section.mOffset = static_cast<std::uint32_t>(buffer.size());
+  section.mCount = static_cast<std::uint32_t>(count);
+
+  const auto* pBytes = reinterpret_cast<const char*>(pData);
+  buffer.insert(buffer.end(), pBytes, pBytes + count * sizeof(T));
+}
+
+} // anon namespace
+
+StyleSheetImage::StyleSheetImage(const char* pData,
+                                 std::size_t size,
+                                 std::vector<char> buffer,
+                                 std::unique_ptr<MappedFile> pFile)
+  : mBuffer(std::move(buffer))
+  , mpFile(std::move(pFile))
+  , mpData(pData)
+  , mSize(size)
+  , mpHeader(nullptr)
+  , mpStringOffsets(nullptr)
+  , mpStringData(nullptr)
+  , mpNodes(nullptr)
+  , mpEdges(nullptr)
+  , mpProperties(nullptr)
+  , mpValues(nullptr)
+  , mpArgs(nullptr)
+  , mpLineStarts(nullptr)
+{
+  // the sections are accessed in place, which requires proper alignment.
+  // Mapped files are page aligned, but data read from qrc resources might
+  // not be.
+  if (reinterpret_cast<std::uintptr_t>(mpData) % alignof(std::uint32_t) != 0) {
+    mBuffer.assign(mpData, mpData + mSize);
+    mpFile.reset();
+    mpData = mBuffer.data();
+  }
+
+  validate();
+
+  mpHeader = reinterpret_cast<const image::Header*>(mpData);
+  mpStringOffsets = sectionData<std::uint32_t>(mpData, mpHeader->mStringOffsets);
+  mpStringData = sectionData<char>(mpData, mpHeader->mStringData);
+  mpNodes = sectionData<image::Node>(mpData, mpHeader->mNodes);
+  mpEdges = sectionData<image::Edge>(mpData, mpHeader->mEdges);
+  mpProperties = sectionData<image::PropertyDef>(mpData, mpHeader->mProperties);
+  mpValues = sectionData<image::Value>(mpData, mpHeader->mValues);
+  mpArgs = sectionData<std::uint32_t>(mpData, mpHeader->mArgs);
+  mpLineStarts = sectionData<std::uint32_t>(mpData, mpHeader->mLineStarts);
+}
+
+StyleSheetImage::~StyleSheetImage() = default;
+
+std::shared_ptr<const StyleSheetImage> StyleSheetImage::fromBuffer(
+  std::vector<char> buffer)
+{
+  // moving the vector keeps its data in place
+  const auto* pData = buffer.data();
+  const auto size = buffer.size();
+  return std::shared_ptr<const StyleSheetImage>(
+    new StyleSheetImage(pData, size, std::move(buffer), nullptr));
+}
+
+std::shared_ptr<const StyleSheetImage> StyleSheetImage::load(const QString& path)
+{
+  std::unique_ptr<MappedFile> pFile(new MappedFile(path));
+  const auto* pData = pFile->begin();
+  const auto size = std::size_t(pFile->end() - pFile->begin());
+  return std::shared_ptr<const StyleSheetImage>(
+    new StyleSheetImage(pData, size, std::vector<char>(), std::move(pFile)));
+}
+
+std::shared_ptr<const StyleSheetImage> StyleSheetImage::fromStaticData(
+  const char* pData, std::size_t size)
+{
+  return std::shared_ptr<const StyleSheetImage>(
+    new StyleSheetImage(pData, size, std::vector<char>(), nullptr));
+}
+
+void StyleSheetImage::validate() const
+{
+  const auto fail = [](const std::string& msg) {
+    throw ParseException("Invalid compiled style sheet: " + msg);
+  };
+
+  if (mSize < sizeof(image::Header)) {
+    fail("truncated header");
+  }
+
+  const auto& header = *reinterpret_cast<const image::Header*>(mpData);
+  if (std::memcmp(header.mMagic, image::kMagic, sizeof(image::kMagic)) != 0) {
+    fail("bad magic");
+  }
+  if (header.mByteOrderMark != image::kByteOrderMark) {
+    fail("byte order mismatch");
+  }
+  if (header.mVersion != image::kVersion) {
+    fail("unsupported version " + std::to_string(header.mVersion));
+  }
+  if (header.mSize != mSize) {
+    fail("size mismatch");
+  }
+
+  if (!isValidSection<std::uint32_t>(header.mStringOffsets, mSize)
+      || !isValidSection<char>(header.mStringData, mSize)
+      || !isValidSection<image::Node>(header.mNodes, mSize)
+      || !isValidSection<image::Edge>(header.mEdges, mSize)
+      || !isValidSection<image::PropertyDef>(header.mProperties, mSize)
+      || !isValidSection<image::Value>(header.mValues, mSize)
+      || !isValidSection<std::uint32_t>(header.mArgs, mSize)
+      || !isValidSection<std::uint32_t>(header.mFontFaces, mSize)
+      || !isValidSection<std::uint32_t>(header.mLineStarts, mSize)) {
+    fail("section out of bounds");
+  }
+
+  const auto* pStringOffsets = sectionData<std::uint32_t>(mpData, header.mStringOffsets);
+  if (header.mStringOffsets.mCount == 0 || header.mNodes.mCount == 0
+      || header.mLineStarts.mCount == 0) {
+    fail("missing string table, root node or line index");
+  }
+  for (std::uint32_t i = 0; i < header.mStringOffsets.mCount; ++i) {
+    if (pStringOffsets[i] > header.mStringData.mCount
+        || (i > 0 && pStringOffsets[i] < pStringOffsets[i - 1])) {
+      fail("bad string table");
+    }
+  }
+
+  const auto stringCount = header.mStringOffsets.mCount - 1;
+  const auto isString = [stringCount](std::uint32_t index) {
+    return index < stringCount;
+  };
+
+  const auto* pNodes = sectionData<image::Node>(mpData, header.mNodes);
+  const auto* pEdges = sectionData<image::Edge>(mpData, header.mEdges);
+  for (std::uint32_t i = 0; i < header.mNodes.mCount; ++i) {
+    const auto& node = pNodes[i];
+    if (!isValidRange(node.mFirstEdge, node.mEdgeCount, header.mEdges.mCount)
+        || !isValidRange(
+             node.mFirstProperty, node.mPropertyCount, header.mProperties.mCount)) {
+      fail("bad node");
+    }
+    // children always follow their parent, which rules out cycles
+    for (std::uint32_t e = node.mFirstEdge; e < node.mFirstEdge + node.mEdgeCount;
+         ++e) {
+      if (!isString(pEdges[e].mKey) || pEdges[e].mNode <= i
+          || pEdges[e].mNode >= header.mNodes.mCount) {
+        fail("bad edge");
+      }
+    }
+  }
+
+  const auto* pProperties = sectionData<image::PropertyDef>(mpData, header.mProperties);
+  for (std::uint32_t i = 0; i < header.mProperties.mCount; ++i) {
+    const auto& property = pProperties[i];
+    if (!isString(property.mName)
+        || !isValidRange(
+             property.mFirstValue, property.mValueCount, header.mValues.mCount)) {
+      fail("bad property");
+    }
+  }
+
+  const auto* pValues = sectionData<image::Value>(mpData, header.mValues);
+  for (std::uint32_t i = 0; i < header.mValues.mCount; ++i) {
+    const auto& value = pValues[i];
+    if (value.mKind > image::kExpression || !isString(value.mString)
+        || !isValidRange(value.mFirstArg, value.mArgCount, header.mArgs.mCount)) {
+      fail("bad value");
+    }
+  }
+
+  const auto* pArgs = sectionData<std::uint32_t>(mpData, header.mArgs);
+  const auto* pFontFaces = sectionData<std::uint32_t>(mpData, header.mFontFaces);
+  if (!std::all_of(pArgs, pArgs + header.mArgs.mCount, isString)
+      || !std::all_of(pFontFaces, pFontFaces + header.mFontFaces.mCount, isString)) {
+    fail("bad string reference");
+  }
+}
+
+std::uint32_t StyleSheetImage::findChild(std::uint32_t nodeIndex,
+                                         std::uint32_t key) const
+{
+  const auto& nd = node(nodeIndex);
+  const auto* first = edges(nd);
+  const auto* last = first + nd.mEdgeCount;
+
+  const auto it = std::lower_bound(first, last, key, [](const image::Edge& edge,
+                                                        std::uint32_t k) {
+    return edge.mKey < k;
+  });
+
+  return it != last && it->mKey == key ? it->mNode : image::kNoNode;
+}
+
+std::vector<std::string> StyleSheetImage::fontFaceUrls() const
+{
+  const auto* pFontFaces = sectionData<std::uint32_t>(mpData, mpHeader->mFontFaces);
+
+  std::vector<std::string> result;
+  for (std::uint32_t i = 0; i < mpHeader->mFontFaces.mCount; ++i) {
+    result.emplace_back(string(pFontFaces[i]).to_string());
+  }
+  return result;
+}
+
+int StyleSheetImage::line(int byteOfs) const
+{
+  const auto* last = mpLineStarts + mpHeader->mLineStarts.mCount;
+  auto it = std::upper_bound(mpLineStarts, last, std::uint32_t(byteOfs));
+  return static_cast<int>(std::distance(mpLineStarts, it));
+}
+
+int StyleSheetImage::column(int byteOfs) const
+{
+  const auto ln = line(byteOfs);
+  return ln > 0 ? byteOfs - int(mpLineStarts[ln - 1]) : byteOfs;
+}
+
+StyleSheetImageBuilder::StyleSheetImageBuilder()
+  : mStringOffsets(1, 0)
+{
+}
+
+std::uint32_t StyleSheetImageBuilder::addString(const std::string& str)
+{
+  auto it = mStringIndices.find(str);
+  if (it != mStringIndices.end()) {
+    return it->second;
+  }
+
+  const auto index = static_cast<std::uint32_t>(mStringOffsets.size() - 1);
+  mStringData += str;
+  mStringOffsets.push_back(static_cast<std::uint32_t>(mStringData.size()));
+  mStringIndices.emplace(str, index);
+  return index;
+}
+
+std::vector<char> StyleSheetImageBuilder::finish() const
+{
+  image::Header header;
+  std::memcpy(header.mMagic, image::kMagic, sizeof(header.mMagic));
+  header.mVersion = image::kVersion;
+  header.mByteOrderMark = image::kByteOrderMark;
+
+  std::vector<char> buffer(sizeof(image::Header));
+  appendSection(
+    buffer, header.mStringOffsets, mStringOffsets.data(), mStringOffsets.size());
+  appendSection(buffer, header.mNodes, nodes.data(), nodes.size());
+  appendSection(buffer, header.mEdges, edges.data(), edges.size());
+  appendSection(buffer, header.mProperties, properties.data(), properties.size());
+  appendSection(buffer, header.mValues, values.data(), values.size());
+  appendSection(buffer, header.mArgs, args.data(), args.size());
+  appendSection(buffer, header.mFontFaces, fontFaces.data(), fontFaces.size());
+  appendSection(buffer, header.mLineStarts, lineStarts.data(), lineStarts.size());
+  appendSection(buffer, header.mStringData, mStringData.data(), mStringData.size());
+
+  header.mSize = static_cast<std::uint32_t>(buffer.size());
+  std::memcpy(buffer.data(), &header, sizeof(header));
+
+  return buffer;
+}
+
+} // namespace stylesheets
+} // namespace aqt
@@ -0,0 +1,291 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <QtCore/QString>
+#include <boost/utility/string_ref.hpp>
+RESTORE_WARNINGS
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*! @cond DOXYGEN_IGNORE */
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+class MappedFile;
+
+/*! The layout of the precompiled binary style sheet format
+ *
+ * An image contains the match tree of a single style sheet as flat arrays
+ * of 32 bit words, which reference each other by index.  All sections are
+ * addressed relative to the start of the image; strings are stored once in
+ * a string table and referenced by index.  The image can be used in place
+ * after mapping it into memory and does not require any per node
+ * allocation.
+ *
+ * Images are written in the byte order of the machine compiling them and
+ * are rejected on machines with a different byte order.
+ */
+namespace image
+{
+
+const char kMagic[8] = {'A', 'Q', 'T', 'S', 'S', 'B', 'I', 'N'};
+const std::uint32_t kVersion = 2;
+const std::uint32_t kByteOrderMark = 0x01020304;
+const std::uint32_t kNoNode = 0xffffffff;
+
+struct Section {
+  std::uint32_t mOffset;
+  std::uint32_t mCount;
+};
+
+struct Header {
+  char mMagic[8];
+  std::uint32_t mVersion;
+  std::uint32_t mByteOrderMark;
+  std::uint32_t mSize;
+  //! mCount is the number of strings + 1; string i spans [off[i], off[i+1])
+  Section mStringOffsets;
+  Section mStringData;
+  Section mNodes;
+  Section mEdges;
+  Section mProperties;
+  Section mValues;
+  Section mArgs;
+  Section mFontFaces;
+  Section mLineStarts;
+};
+
+/*! A match node.  Node 0 is the root; children always follow their parent.
+ * Nodes are written in breadth-first order and nodes with the same property
+ * definitions share their range of properties. */
+struct Node {
+  std::uint32_t mFirstEdge;
+  std::uint32_t mEdgeCount;
+  std::uint32_t mFirstProperty;
+  std::uint32_t mPropertyCount;
+};
+
+//! An edge to a child node; the edges of a node are sorted by key string index
+struct Edge {
+  std::uint32_t mKey;
+  std::uint32_t mNode;
+};
+
+struct PropertyDef {
+  std::uint32_t mName;
+  std::uint32_t mByteOfs;
+  std::uint32_t mFirstValue;
+  std::uint32_t mValueCount;
+};
+
+enum ValueKind : std::uint32_t { kString = 0, kExpression = 1 };
+
+//! A property value; for expressions mString is the name
+struct Value {
+  std::uint32_t mKind;
+  std::uint32_t mString;
+  std::uint32_t mFirstArg;
+  std::uint32_t mArgCount;
+};
+
+} // namespace image
+
+/*! A style sheet compiled into the binary image format
+ *
+ * An image is either compiled in memory from a parsed style sheet (see
+ * compileStyleSheet()) or loaded from a precompiled @c .css.bin file.  The
+ * latter maps the file into memory and validates it once; afterwards all
+ * accessors work directly on the mapped data.
+ */
+class StyleSheetImage
+{
+public:
+  /*! @throw ParseException if @p buffer does not contain a valid image */
+  static std::shared_ptr<const StyleSheetImage> fromBuffer(std::vector<char> buffer);
+
+  /*! Maps the file at @p path, which must not be truncated while the image
+   *  is alive; replace it by renaming a new file instead.
+   *
+   *  @throw std::ios_base::failure if the file at @p path could not be read
+   *  @throw ParseException if the file does not contain a valid image */
+  static std::shared_ptr<const StyleSheetImage> load(const QString& path);
+
+  /*! Uses @p pData in place, which must outlive the image
+   *
+   * This is meant for images linked into the application as generated by
+   * <tt>aqt-stylec --cpp</tt>.  Data not aligned to 32 bit is copied.
+   *
+   * @throw ParseException if @p pData does not contain a valid image */
+  static std::shared_ptr<const StyleSheetImage> fromStaticData(const char* pData,
+                                                               std::size_t size);
+
+  StyleSheetImage(const StyleSheetImage&) = delete;
+  StyleSheetImage& operator=(const StyleSheetImage&) = delete;
+  ~StyleSheetImage();
+
+  const char* data() const
+  {
+    return mpData;
+  }
+
+  std::size_t size() const
+  {
+    return mSize;
+  }
+
+  std::uint32_t stringCount() const
+  {
+    return mpHeader->mStringOffsets.mCount - 1;
+  }
+
+  std::uint32_t nodeCount() const
+  {
+    return mpHeader->mNodes.mCount;
+  }
+
+  std::uint32_t edgeCount() const
+  {
+    return mpHeader->mEdges.mCount;
+  }
+
+  std::uint32_t propertyCount() const
+  {
+    return mpHeader->mProperties.mCount;
+  }
+
+  const image::Node& node(std::uint32_t index) const
+  {
+    return mpNodes[index];
+  }
+
+  const image::Edge& edge(std::uint32_t index) const
+  {
+    return mpEdges[index];
+  }
+
+  const image::PropertyDef& property(std::uint32_t index) const
+  {
+    return mpProperties[index];
+  }
+
+  const image::Edge* edges(const image::Node& node) const
+  {
+    return mpEdges + node.mFirstEdge;
+  }
+
+  const image::PropertyDef* properties(const image::Node& node) const
+  {
+    return mpProperties + node.mFirstProperty;
+  }
+
+  const image::Value* values(const image::PropertyDef& property) const
+  {
+    return mpValues + property.mFirstValue;
+  }
+
+  const std::uint32_t* args(const image::Value& value) const
+  {
+    return mpArgs + value.mFirstArg;
+  }
+
+  boost::string_ref string(std::uint32_t index) const
+  {
+    return boost::string_ref(mpStringData + mpStringOffsets[index],
+                             mpStringOffsets[index + 1] - mpStringOffsets[index]);
+  }
+
+  /*! Returns the child of @p node reached through the key with string
+   *  index @p key or image::kNoNode */
+  std::uint32_t findChild(std::uint32_t node, std::uint32_t key) const;
+
+  std::vector<std::string> fontFaceUrls() const;
+
+  /*! Returns the 1-based source line number of @p byteOfs */
+  int line(int byteOfs) const;
+  /*! Returns the 0-based source column of @p byteOfs */
+  int column(int byteOfs) const;
+
+private:
+  StyleSheetImage(const char* pData,
+                  std::size_t size,
+                  std::vector<char> buffer,
+                  std::unique_ptr<MappedFile> pFile);
+
+  void validate() const;
+
+  std::vector<char> mBuffer;
+  std::unique_ptr<MappedFile> mpFile;
+  const char* mpData;
+  std::size_t mSize;
+  const image::Header* mpHeader;
+  const std::uint32_t* mpStringOffsets;
+  const char* mpStringData;
+  const image::Node* mpNodes;
+  const image::Edge* mpEdges;
+  const image::PropertyDef* mpProperties;
+  const image::Value* mpValues;
+  const std::uint32_t* mpArgs;
+  const std::uint32_t* mpLineStarts;
+};
+
+/*! Collects the sections of an image and writes it */
+class StyleSheetImageBuilder
+{
+public:
+  StyleSheetImageBuilder();
+
+  /*! Returns the index of @p str in the string table, adding it if needed */
+  std::uint32_t addString(const std::string& str);
+
+  std::vector<char> finish() const;
+
+  std::vector<image::Node> nodes;
+  std::vector<image::Edge> edges;
+  std::vector<image::PropertyDef> properties;
+  std::vector<image::Value> values;
+  std::vector<std::uint32_t> args;
+  std::vector<std::uint32_t> fontFaces;
+  std::vector<std::uint32_t> lineStarts;
+
+private:
+  std::vector<std::uint32_t> mStringOffsets;
+  std::string mStringData;
+  std::unordered_map<std::string, std::uint32_t> mStringIndices;
+};
+
+} // namespace stylesheets
+} // namespace aqt
+
+/*! @endcond */
@@ -0,0 +1,282 @@
+/*
+Copyright (c) 2014-2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "StyleSnapshot.hpp"
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+namespace
+{
+
+//! Fewer paths than this per thread are resolved on the calling thread alone
+const std::size_t kMinPrewarmPathsPerWorker = 64;
+
+//! Returns the paths which are a prefix of more than one of @p paths, where
+//! each path counts as a prefix of itself
+std::vector<const PathNode*> sharedPrefixes(const std::vector<const PathNode*>& paths)
+{
+  std::unordered_map<const PathNode*, std::size_t> useCounts;
+  std::vector<const PathNode*> result;
+
+  for (const auto* pPath : paths) {
+    for (auto* pPrefix = pPath; pPrefix; pPrefix = pPrefix->parent()) {
+      auto& useCount = useCounts[pPrefix];
+      if (++useCount == 2) {
+        result.push_back(pPrefix);
+      } else if (useCount > 2) {
+        // all further ancestors have been counted twice already
+        break;
+      }
+    }
+  }
+
+  return result;
+}
+
+//! Returns the scratch buffer of the calling thread, which is reused by all
+//! lookups on it
+IMatchScratch& threadScratch()
+{
+  thread_local std::unique_ptr<IMatchScratch> tpScratch = createMatchScratch();
+  return *tpScratch;
+}
+
+} // anon namespace
+
+StyleSnapshot::StyleSnapshot(std::unique_ptr<IStyleMatchTree> pTree,
+                             unsigned int generation)
+  : mpTree(std::move(pTree))
+  , mpRootState(createMatchState(mpTree.get()))
+  , mGeneration(generation)
+{
+}
+
+unsigned int StyleSnapshot::generation() const
+{
+  return mGeneration;
+}
+
+const IStyleMatchTree* StyleSnapshot::tree() const
+{
+  return mpTree.get();
+}
+
+std::shared_ptr<const PropertyMap> StyleSnapshot::properties(const PathNode* pPath) const
+{
+  Entry entry;
+  if (lookup(pPath, entry)) {
+    return entry.mpProperties;
+  }
+
+  return resolve(pPath, threadScratch(), true).mpProperties;
+}
+
+void StyleSnapshot::prewarm(const std::vector<const PathNode*>& paths)
+{
+  const auto workerCount =
+    std::max<std::size_t>(std::min<std::size_t>(std::thread::hardware_concurrency(),
+                                                paths.size() / kMinPrewarmPathsPerWorker),
+                          1);
+
+  // resolve the prefixes shared by several paths before fanning out, so
+  // that workers don't match them again on their own
+  if (workerCount > 1) {
+    auto& scratch = threadScratch();
+    for (const auto* pPrefix : sharedPrefixes(paths)) {
+      resolve(pPrefix, scratch, false);
+    }
+  }
+
+  // each worker resolves a contiguous block of the paths with the scratch
+  // buffer of the thread it runs on
+  auto resolveBlock = [&](std::size_t i) {
+    auto& scratch = threadScratch();
+    const auto first = paths.size() * i / workerCount;
+    const auto last = paths.size() * (i + 1) / workerCount;
+    for (auto j = first; j != last; ++j) {
+      resolve(paths[j], scratch, true);
+    }
+  };
+
+  std::vector<std::future<void>> workers;
+  try {
+    for (std::size_t i = 1; i < workerCount; ++i) {
+      workers.emplace_back(std::async(std::launch::async, resolveBlock, i));
+    }
+  } catch (const std::system_error&) {
+    // out of threads; the blocks not started yet are resolved on this one
+  }
+
+  resolveBlock(0);
+  for (auto i = workers.size() + 1; i < workerCount; ++i) {
+    resolveBlock(i);
+  }
+
+  for (auto& worker : workers) {
+    worker.get();
+  }
+}
+
+void StyleSnapshot::forget(const PathNode* pPath)
+{
+  QWriteLocker lock(&mLock);
+  auto iEntry = mEntries.find(pPath);
+  if (iEntry == mEntries.end()) {
+    return;
+  }
+
+  // drop the entry along with the ancestors which were only kept for it
+  iEntry->second.mIsRequested = false;
+  while (iEntry->second.mChildCount == 0 && !iEntry->second.mIsRequested) {
+    const auto* pParent = iEntry->first ? iEntry->first->parent() : nullptr;
+    mEntries.erase(iEntry);
+
+    iEntry = pParent ? mEntries.find(pParent) : mEntries.end();
+    if (iEntry == mEntries.end()) {
+      break;
+    }
+    --iEntry->second.mChildCount;
+  }
+}
+
+std::size_t StyleSnapshot::propertyMapCount() const
+{
+  QReadLocker lock(&mLock);
+  return mEntries.size();
+}
+
+std::size_t StyleSnapshot::matchStateCount() const
+{
+  // the empty path's entry shares the root state, which always exists
+  QReadLocker lock(&mLock);
+  return mEntries.size() + 1 - mEntries.count(nullptr);
+}
+
+bool StyleSnapshot::lookup(const PathNode* pPath, Entry& entry) const
+{
+  {
+    QReadLocker lock(&mLock);
+    const auto iEntry = mEntries.find(pPath);
+    if (iEntry == mEntries.end()) {
+      return false;
+    }
+    if (iEntry->second.mIsRequested) {
+      entry = iEntry->second;
+      return true;
+    }
+  }
+
+  // the first request for a path resolved as an ancestor only pins it
+  QWriteLocker lock(&mLock);
+  const auto iEntry = mEntries.find(pPath);
+  if (iEntry == mEntries.end()) {
+    return false;
+  }
+  iEntry->second.mIsRequested = true;
+  entry = iEntry->second;
+  return true;
+}
+
+StyleSnapshot::Entry StyleSnapshot::resolve(const PathNode* pPath,
+                                            IMatchScratch& scratch,
+                                            bool isRequested) const
+{
+  using std::begin;
+  using std::end;
+
+  Entry entry;
+  if (isRequested ? lookup(pPath, entry) : find(pPath, entry)) {
+    return entry;
+  }
+
+  // the state of a path is derived from its parent's, so resolving it only
+  // matches its last element.  This runs without holding the lock.
+  Entry parent;
+  if (pPath && pPath->parent()) {
+    parent = resolve(pPath->parent(), scratch, false);
+  }
+
+  entry.mpState =
+    pPath ? extendMatchState(parent.mpState ? parent.mpState : mpRootState,
+                             pPath->element())
+          : mpRootState;
+
+  auto props = matchPath(entry.mpState.get(), &scratch);
+  if (parent.mpProperties) {
+    if (props.empty()) {
+      // share our ancestor props without creating our own props instance
+      entry.mpProperties = parent.mpProperties;
+    } else {
+      props.insert(begin(*parent.mpProperties), end(*parent.mpProperties));
+    }
+  }
+
+  if (!entry.mpProperties) {
+    entry.mpProperties = std::make_shared<PropertyMap>(std::move(props));
+  }
+  entry.mIsRequested = isRequested;
+
+  // if another thread has resolved the path meanwhile its entry is kept, so
+  // that all children share the same parent map
+  QWriteLocker lock(&mLock);
+  const auto result = mEntries.emplace(pPath, std::move(entry));
+  auto& cached = result.first->second;
+  cached.mIsRequested = cached.mIsRequested || isRequested;
+
+  if (result.second && pPath && pPath->parent()) {
+    const auto iParent = mEntries.find(pPath->parent());
+    if (iParent == mEntries.end()) {
+      // the parent has been forgotten meanwhile; the result is still valid
+      // but can't be cached without it
+      entry = std::move(cached);
+      mEntries.erase(result.first);
+      return entry;
+    }
+    ++iParent->second.mChildCount;
+  }
+
+  return cached;
+}
+
+bool StyleSnapshot::find(const PathNode* pPath, Entry& entry) const
+{
+  QReadLocker lock(&mLock);
+  const auto iEntry = mEntries.find(pPath);
+  if (iEntry == mEntries.end()) {
+    return false;
+  }
+  entry = iEntry->second;
+  return true;
+}
+
+} // namespace stylesheets
+} // namespace aqt
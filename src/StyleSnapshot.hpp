@@ -0,0 +1,183 @@
+/*
+Copyright (c) 2014-2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Convert.hpp"
+#include "PathNode.hpp"
+#include "StyleMatchTree.hpp"
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QString>
+#include <boost/optional.hpp>
+RESTORE_WARNINGS
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace aqt
+{
+namespace stylesheets
+{
+
+/*! The styles loaded at one point in time
+ *
+ * A snapshot holds the match tree built from the style sheets of one load
+ * and a cache of the properties resolved against it.  The tree never
+ * changes after the snapshot has been created; a reload creates a new
+ * snapshot with a higher generation instead.  Snapshots are shared by
+ * reference counting and all const functions are thread safe, so e.g. the
+ * scene graph render thread or a worker thread can look up styles while the
+ * GUI thread moves on:
+ *
+ * @code
+ * // on the GUI thread, e.g. in updatePolish()
+ * mpSnapshot = pStyleEngine->snapshot();
+ * mpPath = pStyleSet->pathNode();
+ *
+ * // in updatePaintNode() on the render thread
+ * if (auto color = mpSnapshot->get<QColor>(mpPath, QStringLiteral("color"))) {
+ *   pNode->setColor(*color);
+ * }
+ * @endcode
+ *
+ * The cache is guarded by a read-write lock.  Looking up an already
+ * resolved path only takes the read lock, so concurrent readers never wait
+ * for each other.  The properties of a path are resolved on first use
+ * without holding the lock and added to the cache in a short write locked
+ * section, during which readers wait.  A first lookup of a path thus costs
+ * matching its unresolved elements and creating its property map, which
+ * also locks the global atom table for a moment.  Matching reuses one
+ * scratch buffer per thread, which is kept until the thread ends.  Callers which cannot
+ * afford that should resolve their paths with prewarm() beforehand.
+ *
+ * Paths are interned and never released, so their nodes can be passed to
+ * any thread.
+ */
+class StyleSnapshot
+{
+public:
+  StyleSnapshot(std::unique_ptr<IStyleMatchTree> pTree, unsigned int generation);
+
+  StyleSnapshot(const StyleSnapshot&) = delete;
+  StyleSnapshot& operator=(const StyleSnapshot&) = delete;
+
+  //! Returns the StyleEngine::generation() the snapshot belongs to
+  unsigned int generation() const;
+
+  const IStyleMatchTree* tree() const;
+
+  /*! Returns the effective properties of @p pPath
+   *
+   * Paths without properties of their own share the map of their parent.
+   * The result is cached until forget() is called for @p pPath or the
+   * snapshot is destroyed.  Never returns nullptr.
+   */
+  std::shared_ptr<const PropertyMap> properties(const PathNode* pPath) const;
+
+  /*! Returns the property @p key of @p pPath converted to @p T
+   *
+   * Returns boost::none if the property is not set, has more than one
+   * value or is not convertible to @p T.
+   */
+  template <typename T>
+  boost::optional<T> get(const PathNode* pPath, const QString& key) const
+  {
+    const auto pProps = properties(pPath);
+    const auto iProp = pProps->find(key);
+    if (iProp == pProps->end() || iProp->second.mValues.size() != 1) {
+      return boost::none;
+    }
+
+    return convertProperty<T>(iProp->second.mValues[0]);
+  }
+
+  /*! Resolves the properties of @p paths in parallel
+   *
+   * The paths are split into blocks which are matched against the tree on
+   * worker threads, each with the scratch memory of its thread.
+   */
+  void prewarm(const std::vector<const PathNode*>& paths);
+
+  /*! Drops the cached properties and match state of @p pPath
+   *
+   * The entry is kept as long as paths below @p pPath are still cached.
+   * Ancestors which have only been resolved on the way to @p pPath are
+   * dropped with it as soon as nothing else below them is cached anymore.
+   * Maps handed out before stay valid.
+   */
+  void forget(const PathNode* pPath);
+
+  std::size_t propertyMapCount() const;
+  std::size_t matchStateCount() const;
+
+private:
+  /*! A resolved path
+   *
+   * An entry is kept while it is requested, i.e. passed to properties() or
+   * prewarm() and not forgotten since, or while any of its children are
+   * cached.
+   */
+  struct Entry {
+    Entry()
+      : mChildCount(0)
+      , mIsRequested(false)
+    {
+    }
+
+    std::shared_ptr<const IMatchState> mpState;
+    std::shared_ptr<PropertyMap> mpProperties;
+    std::size_t mChildCount;
+    bool mIsRequested;
+  };
+
+  using Entries = std::unordered_map<const PathNode*, Entry>;
+
+  //! Copies the cache entry of @p pPath to @p entry if there is one
+  bool find(const PathNode* pPath, Entry& entry) const;
+
+  //! Like find() but marks the entry as requested
+  bool lookup(const PathNode* pPath, Entry& entry) const;
+
+  /*! Returns the cache entry of @p pPath, resolving it with @p scratch first
+   *  if needed
+   *
+   * Ancestors are resolved as well but only marked as requested if
+   * @p isRequested is set for them on their own.
+   */
+  Entry resolve(const PathNode* pPath, IMatchScratch& scratch, bool isRequested) const;
+
+  std::unique_ptr<IStyleMatchTree> mpTree;
+  std::shared_ptr<const IMatchState> mpRootState;
+  unsigned int mGeneration;
+
+  mutable QReadWriteLock mLock;
+  mutable Entries mEntries;
+};
+
+} // namespace stylesheets
+} // namespace aqt
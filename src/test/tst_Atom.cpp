@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "Atom.hpp"
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <gtest/gtest.h>
+RESTORE_WARNINGS
+
+#include <string>
+#include <thread>
+#include <vector>
+
+//========================================================================================
+
+using namespace aqt::stylesheets;
+
+TEST(AtomTest, internedNamesMapToTheSameAtom)
+{
+  const auto foo = internAtom("AtomTest_Foo");
+  const auto bar = internAtom("AtomTest_Bar");
+
+  EXPECT_NE(foo, bar);
+  EXPECT_EQ(foo, internAtom("AtomTest_Foo"));
+  EXPECT_EQ(bar, internAtom(std::string("AtomTest_") + "Bar"));
+
+  EXPECT_EQ("AtomTest_Foo", atomName(foo));
+  EXPECT_EQ("AtomTest_Bar", atomName(bar));
+
+  const auto count = atomCount();
+  internAtom("AtomTest_Foo");
+  EXPECT_EQ(count, atomCount());
+  internAtom("AtomTest_Baz");
+  EXPECT_EQ(count + 1, atomCount());
+}
+
+TEST(AtomTest, findingNamesDoesNotInternThem)
+{
+  const auto foo = internAtom("AtomTest_FindFoo");
+  EXPECT_EQ(foo, findAtom("AtomTest_FindFoo"));
+
+  const auto count = atomCount();
+  EXPECT_EQ(kNoAtom, findAtom("AtomTest_FindBar"));
+  EXPECT_EQ(kNoAtom, findAtom("AtomTest_FindBar"));
+  EXPECT_EQ(count, atomCount());
+}
+
+TEST(AtomTest, namesCanBeInternedFromManyThreads)
+{
+  const int kThreads = 4;
+  const int kNames = 1000;
+
+  std::vector<std::vector<AtomId>> atoms(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([t, &atoms] {
+      for (int i = 0; i < kNames; ++i) {
+        atoms[size_t(t)].push_back(internAtom("AtomTest_" + std::to_string(i)));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 1; t < kThreads; ++t) {
+    EXPECT_EQ(atoms[0], atoms[size_t(t)]);
+  }
+  for (int i = 0; i < kNames; ++i) {
+    EXPECT_EQ("AtomTest_" + std::to_string(i), atomName(atoms[0][size_t(i)]));
+  }
+}
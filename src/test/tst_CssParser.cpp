@@ -30,6 +30,10 @@ SUPPRESS_WARNINGS
 #include <gtest/gtest.h>
 RESTORE_WARNINGS
 
+#include <sstream>
+#include <string>
+#include <vector>
+
 //========================================================================================
 
 using namespace aqt::stylesheets;
@@ -81,6 +85,60 @@ size_t getNumberOfValues(const PropertyValues& val)
   return val.size();
 }
 
+std::string dumpStyleSheet(const StyleSheet& ss)
+{
+  std::ostringstream os;
+
+  for (const auto& ps : ss.propsets) {
+    os << "@" << ps.mSourceLoc.mByteOfs;
+    for (const auto& sel : ps.selectors) {
+      os << " [";
+      for (const auto& parts : sel) {
+        os << "(";
+        for (const auto& part : parts) {
+          os << part << ";";
+        }
+        os << ")";
+      }
+      os << "]";
+    }
+    os << " {" << std::endl;
+
+    for (const auto& prop : ps.properties) {
+      os << "  @" << prop.mSourceLoc.mByteOfs << " " << prop.name << ":";
+      for (const auto& value : prop.values) {
+        if (const std::string* str = boost::get<std::string>(&value)) {
+          os << " '" << *str << "'";
+        } else if (const Expression* expr = boost::get<Expression>(&value)) {
+          os << " " << expr->name << "(";
+          for (const auto& arg : expr->args) {
+            os << "'" << arg << "';";
+          }
+          os << ")";
+        }
+      }
+      os << std::endl;
+    }
+    os << "}" << std::endl;
+  }
+
+  for (const auto& ff : ss.fontfaces) {
+    os << "@font-face " << ff.url << std::endl;
+  }
+
+  return os.str();
+}
+
+std::string parseAndDump(const std::string& src, ParserBackend backend)
+{
+  try {
+    return dumpStyleSheet(parseStdString(src, backend));
+  } catch (const ParseException& e) {
+    return "error: " + e.message() + " at " + std::to_string(e.line()) + ":"
+           + std::to_string(e.column());
+  }
+}
+
 } // anonymous namespace
 
 TEST(CssParserTest, ParserFromString_basic)
@@ -135,6 +193,27 @@ TEST(CssParserTest, ParserFromString_selectors)
   EXPECT_EQ(selectorName(ss, 5, 0, 1), ".a");
 }
 
+TEST(CssParserTest, ParserFromString_pseudoStateSelectors)
+{
+  const std::string src =
+    "A:hover { color: red; }\n"
+    "A.b:focus:pressed .c { color: blue; }\n"
+    ":disabled { color: gray; }\n";
+
+  StyleSheet ss = parseStdString(src);
+  EXPECT_EQ(ss.propsets.size(), 3);
+  EXPECT_EQ(selectorName(ss, 0, 0, 0), "A");
+  EXPECT_EQ(selectorName(ss, 0, 0, 1), ":hover");
+
+  EXPECT_EQ(selectorName(ss, 1, 0, 0), "A");
+  EXPECT_EQ(selectorName(ss, 1, 0, 1), ".b");
+  EXPECT_EQ(selectorName(ss, 1, 0, 2), ":focus");
+  EXPECT_EQ(selectorName(ss, 1, 0, 3), ":pressed");
+  EXPECT_EQ(selectorName(ss, 1, 1, 0), ".c");
+
+  EXPECT_EQ(selectorName(ss, 2, 0, 0), ":disabled");
+}
+
 TEST(CssParserTest, ParserFromString_separatedSelectors)
 {
   const std::string src =
@@ -373,6 +452,130 @@ TEST(CssParserTest, ParserFromString_ExpressionsInLists)
             getExpr(ss.propsets[0].properties[0].values, 2).args);
 }
 
+TEST(CssParserTest, ParserFromString_unexpectedTokensReportLocation)
+{
+  const std::string src =
+    "A {\n"
+    "  color: red;\n"
+    "}\n"
+    "  B { color: ; }\n";
+
+  try {
+    parseStdString(src);
+    FAIL() << "ParseException expected";
+  } catch (const ParseException& e) {
+    EXPECT_EQ(std::string("Found unexpected tokens"), e.message());
+    EXPECT_EQ(4, e.line());
+    EXPECT_EQ(2, e.column());
+  }
+}
+
+TEST(CssParserTest, ParserFromString_missingValueAfterComma)
+{
+  EXPECT_THROW(parseStdString("A { color: red, ; }"), ParseException);
+  EXPECT_THROW(parseStdString("A { color: rgb(1, ); }"), ParseException);
+}
+
+TEST(CssParserTest, RecursiveDescentParserMatchesSpirit)
+{
+  const std::vector<std::string> sources = {
+    "",
+    "  \n\t ",
+    "A { background: red; }",
+    "A.b.c, D > E .f,\r\n G{x:1;y:'a b';z:\"c\"}\n",
+    "// comment\n/* multi\n line */ A /* x */ , B { /* c */ a: b // d\n }",
+    "A { width: 10px; }",
+    "A { x: -foo; y: .5, 50%, #fff, #xyz }",
+    "A { c: rgba(1, 2, 3, 0.4), foo(), bar (a b), url('x y') }",
+    "A { c: f(a, b }",
+    "A { c: red /* c */; }",
+    "@font-face { src: url(\"font.otf\"); }",
+    "@font-face /* a */ { /* b */ src: /* c */ url(foo) /* d */ }",
+    "@font-face { src: url(foo.otf) }",
+    "A { color: red }\n// no newline at end",
+    "A { color: \"\" }",
+    "A { color: \"unterminated }",
+    "> A { a: b }",
+    "A:hover .b:focus:pressed, :custom-state { a: b }",
+    "A: { a: b }",
+    "A } B",
+    "A { a: b",
+  };
+
+  for (const auto& src : sources) {
+    EXPECT_EQ(parseAndDump(src, ParserBackend::kSpirit),
+              parseAndDump(src, ParserBackend::kRecursiveDescent))
+      << "for source: " << src;
+  }
+}
+
+TEST(CssParserTest, ParserFromString_splitAtRuleBoundaries)
+{
+  const std::string rules[] = {"A { a: '}'; }", "\nB { /* } */ b: \"{\"; }",
+                               "\nC { // }\n c: 1; }", "\nD { d: 2; }"};
+  std::string src;
+  std::vector<size_t> ruleEnds;
+  for (const auto& rule : rules) {
+    src += rule;
+    ruleEnds.push_back(src.size());
+  }
+
+  const auto* first = src.data();
+  const auto* last = first + src.size();
+
+  EXPECT_EQ((std::vector<const char*>{first, last}),
+            detail::splitAtRuleBoundaries(first, last, 1, 1));
+
+  // every rule in a chunk of its own, braces in strings and comments are
+  // skipped
+  EXPECT_EQ((std::vector<const char*>{first, first + ruleEnds[0], first + ruleEnds[1],
+                                      first + ruleEnds[2], last}),
+            detail::splitAtRuleBoundaries(first, last, 16, 1));
+
+  // a chunk is never smaller than the minimum size, not even the last one
+  const auto bounds = detail::splitAtRuleBoundaries(first, last, 16, 20);
+  ASSERT_LT(2u, bounds.size());
+  for (auto i = bounds.begin(); std::next(i) != bounds.end(); ++i) {
+    EXPECT_LE(20, *std::next(i) - *i);
+  }
+
+  // a rule is never cut, no matter how small the chunks get
+  const std::string rule = "A { a: 1; b: 2; c: 3; }";
+  const auto* ruleFirst = rule.data();
+  EXPECT_EQ((std::vector<const char*>{ruleFirst, ruleFirst + rule.size()}),
+            detail::splitAtRuleBoundaries(ruleFirst, ruleFirst + rule.size(), 16, 1));
+}
+
+TEST(CssParserTest, ParserFromString_largeSheetsKeepSourceOrder)
+{
+  // big enough to be parsed in several chunks
+  std::string src;
+  std::vector<size_t> offsets;
+  for (int i = 0; i < 8000; ++i) {
+    offsets.push_back(src.size());
+    src += "A" + std::to_string(i) + " { /* } */ a: '}'; // }\n b: " + std::to_string(i)
+           + "; }\n";
+  }
+
+  for (const auto backend : {ParserBackend::kSpirit, ParserBackend::kRecursiveDescent}) {
+    const StyleSheet ss = parseStdString(src, backend, 4);
+    ASSERT_EQ(offsets.size(), ss.propsets.size());
+
+    for (size_t i = 0; i < offsets.size(); ++i) {
+      EXPECT_EQ(int(offsets[i]), ss.propsets[i].mSourceLoc.mByteOfs);
+      EXPECT_EQ("A" + std::to_string(i), selectorName(ss, i, 0, 0));
+      EXPECT_EQ(std::to_string(i), getFirstValue(ss.propsets[i].properties[1].values));
+    }
+  }
+
+  try {
+    parseStdString(src + "B { c: ; }\n", defaultParserBackend(), 4);
+    FAIL() << "ParseException expected";
+  } catch (const ParseException& e) {
+    EXPECT_EQ(int(offsets.size()) * 2 + 1, e.line());
+  }
+}
+
 /* Missing tests:
 
    pathological cases:
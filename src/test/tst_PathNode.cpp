@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "PathNode.hpp"
+
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <gtest/gtest.h>
+RESTORE_WARNINGS
+
+#include <string>
+#include <vector>
+
+//========================================================================================
+
+using namespace aqt::stylesheets;
+
+TEST(PathNodeTest, equalPathsAreTheSameNode)
+{
+  const auto path = UiItemPath{
+    PathElement("Window"), PathElement("Panel", {"a", "b"}), PathElement("Button")};
+
+  const auto* pNode = internPath(path);
+  ASSERT_NE(nullptr, pNode);
+  EXPECT_EQ(pNode, internPath(path));
+  EXPECT_EQ(pNode, internPath(internPath({path[0], path[1]}), path[2]));
+
+  EXPECT_NE(pNode, internPath({path[0], path[1], PathElement("Button", {"a"})}));
+  EXPECT_NE(pNode, internPath({path[0], PathElement("Panel", {"b", "a"}), path[2]}));
+  EXPECT_NE(pNode, internPath({path[1], path[0], path[2]}));
+}
+
+TEST(PathNodeTest, nodesReferToTheirParentPath)
+{
+  const auto path = UiItemPath{PathElement("Window"), PathElement("Panel", {"a"})};
+
+  const auto* pNode = internPath(path);
+  ASSERT_NE(nullptr, pNode);
+  EXPECT_EQ(2u, pNode->depth());
+  EXPECT_EQ(path[1], pNode->element());
+  EXPECT_EQ(internPath({path[0]}), pNode->parent());
+  EXPECT_EQ(1u, pNode->parent()->depth());
+  EXPECT_EQ(nullptr, pNode->parent()->parent());
+
+  EXPECT_EQ(path, pNode->path());
+  EXPECT_EQ(path, pathElements(pNode));
+  EXPECT_EQ(pathToString(path), pathToString(pNode));
+}
+
+TEST(PathNodeTest, emptyPathIsNull)
+{
+  EXPECT_EQ(nullptr, internPath(UiItemPath()));
+  EXPECT_TRUE(pathElements(nullptr).empty());
+}
+
+TEST(PathNodeTest, internedPathsAreNotAddedAgain)
+{
+  const auto path = UiItemPath{PathElement("PathNodeTest_Window"), PathElement("Item")};
+
+  internPath(path);
+  const auto count = internedPathCount();
+  for (int i = 0; i < 10; ++i) {
+    internPath(path);
+  }
+  EXPECT_EQ(count, internedPathCount());
+
+  internPath({path[0], PathElement("Label")});
+  EXPECT_EQ(count + 1, internedPathCount());
+}
+
+TEST(PathNodeTest, tableGrowsWithDistinctPathsOnly)
+{
+  const auto parent = UiItemPath{PathElement("PathNodeTest_List")};
+  const auto count = internedPathCount();
+
+  // items recreated with the same paths, as a list view does when scrolling
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 100; ++i) {
+      auto path = parent;
+      path.emplace_back("Row", std::vector<std::string>{i % 2 ? "odd" : "even"});
+      path.emplace_back("Label");
+      internPath(path);
+    }
+  }
+
+  // the parent and each of its two rows with their label
+  EXPECT_EQ(count + 5, internedPathCount());
+}
@@ -521,6 +521,203 @@ TEST(StyleMatchTreeTest, multipleClassNames_even_without_whitespace)
   EXPECT_EQ("3", propertyAsString(pm, "propC"));
 }
 
+TEST(StyleMatchTreeTest, moreSpecificRulesWinOverLaterLessSpecificOnes)
+{
+  const std::string src =
+    "A.b  { color: green; }\n"
+    ".p A { width: 1; }\n"
+    "P A  { color: blue; }\n"
+    "A    { color: red; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+  UiItemPath p = {PathElement("P", {"p"}), PathElement("A", {"b"})};
+  PropertyMap pm = matchPath(mt.get(), p);
+
+  EXPECT_EQ(2, pm.size());
+  EXPECT_EQ("green", propertyAsString(pm, "color"));
+  EXPECT_EQ("1", propertyAsString(pm, "width"));
+}
+
+TEST(StyleMatchTreeTest, scratchBufferCanBeReused)
+{
+  const std::string src =
+    "A       { color: red; }\n"
+    "B > A   { color: green; width: 2; }\n"
+    "C       { height: 3; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+  auto scratch = createMatchScratch();
+
+  const auto paths = std::vector<UiItemPath>{{PathElement("B"), PathElement("A")},
+                                             {PathElement("C")},
+                                             {PathElement("A")},
+                                             {PathElement("D")}};
+  for (const auto& p : paths) {
+    PropertyMap expected = matchPath(mt.get(), p);
+    PropertyMap pm = matchPath(mt.get(), p, scratch.get());
+
+    EXPECT_EQ(expected.size(), findMatchingProperties(mt.get(), p, scratch.get()));
+    ASSERT_EQ(expected.size(), pm.size());
+    for (const auto& property : expected) {
+      EXPECT_EQ(propertyAsString(expected, property.first.toStdString().c_str()),
+                propertyAsString(pm, property.first.toStdString().c_str()));
+    }
+  }
+
+  EXPECT_EQ("green",
+            propertyAsString(matchPath(mt.get(), paths[0], scratch.get()), "color"));
+}
+
+TEST(StyleMatchTreeTest, descendantsMatchAnyAncestor)
+{
+  const std::string src = "A > B C { color: red; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+
+  // the nearest "B" is not a child of an "A", but a farther one is
+  UiItemPath p = {PathElement("A"), PathElement("B"), PathElement("X"), PathElement("B"),
+                  PathElement("C")};
+  PropertyMap pm = matchPath(mt.get(), p);
+  EXPECT_EQ(1, pm.size());
+  EXPECT_EQ("red", propertyAsString(pm, "color"));
+
+  p = {PathElement("A"), PathElement("X"), PathElement("B"), PathElement("C")};
+  pm = matchPath(mt.get(), p);
+  EXPECT_EQ(0, pm.size());
+}
+
+TEST(StyleMatchTreeTest, descendantSelectorsMatchDistantAncestors)
+{
+  const std::string src =
+    ".frame Panel > Button { color: red; }\n"
+    "Window .frame Button  { width: 1; }\n"
+    "Dialog Button         { height: 2; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+
+  UiItemPath p = {PathElement("Window"), PathElement("Item", {"frame"})};
+  for (int i = 0; i < 40; ++i) {
+    p.emplace_back("Item");
+  }
+  p.emplace_back("Panel");
+  p.emplace_back("Button");
+
+  PropertyMap pm = matchPath(mt.get(), p);
+  EXPECT_EQ(2, pm.size());
+  EXPECT_EQ("red", propertyAsString(pm, "color"));
+  EXPECT_EQ("1", propertyAsString(pm, "width"));
+}
+
+TEST(StyleMatchTreeTest, manyDescendantCombinatorsOnDeepPaths)
+{
+  const std::string src =
+    "A B C D E F { color: red; }\n"
+    "A B C D E G { color: blue; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+
+  UiItemPath p;
+  for (int i = 0; i < 60; ++i) {
+    p.emplace_back(std::string(1, char('A' + i % 4)));
+  }
+  p.emplace_back("F");
+
+  // no "E" in the path
+  EXPECT_EQ(0, matchPath(mt.get(), p).size());
+
+  p.insert(p.end() - 1, PathElement("E"));
+  PropertyMap pm = matchPath(mt.get(), p);
+  EXPECT_EQ(1, pm.size());
+  EXPECT_EQ("red", propertyAsString(pm, "color"));
+}
+
+TEST(StyleMatchTreeTest, matchStatesMatchLikeWholePaths)
+{
+  const std::string src =
+    "A              { color: red; }\n"
+    "B > A          { color: green; width: 2; }\n"
+    "C A            { height: 3; }\n"
+    ".x B > .y      { color: blue; }\n"
+    "A.y            { width: 4; }\n"
+    "C D .x A       { margin: 5; }\n"
+    "C > B > A.y    { margin: 6; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+  auto scratch = createMatchScratch();
+
+  const auto paths =
+    std::vector<UiItemPath>{{PathElement("C"), PathElement("B"), PathElement("A", {"y"})},
+                            {PathElement("C"), PathElement("D", {"x"}), PathElement("B"),
+                             PathElement("A", {"y"})},
+                            {PathElement("C"), PathElement("X"), PathElement("D"),
+                             PathElement("E", {"x"}), PathElement("A")},
+                            {PathElement("B"), PathElement("A")},
+                            {PathElement("A")}};
+
+  for (const auto& p : paths) {
+    auto state = createMatchState(mt.get());
+    for (std::size_t i = 0; i < p.size(); ++i) {
+      state = extendMatchState(state, p[i]);
+
+      const auto prefix = UiItemPath(p.begin(), p.begin() + i + 1);
+      PropertyMap expected = matchPath(mt.get(), prefix);
+      PropertyMap pm = matchPath(state.get(), scratch.get());
+
+      ASSERT_EQ(expected.size(), pm.size()) << prefix;
+      for (const auto& property : expected) {
+        EXPECT_EQ(propertyAsString(expected, property.first.toStdString().c_str()),
+                  propertyAsString(pm, property.first.toStdString().c_str()))
+          << prefix;
+      }
+    }
+  }
+}
+
+TEST(StyleMatchTreeTest, pseudoStatesMatchLikeClasses)
+{
+  const std::string src =
+    "A           { color: red; }\n"
+    "A:hover     { color: green; }\n"
+    ".hover      { width: 1; }\n"
+    ":disabled   { height: 2; }\n"
+    "A:hover > B { margin: 3; }\n"
+    "A:dragged B { color: blue; }\n";
+
+  auto mt = createMatchTree(parseStdString(src));
+
+  const auto hover = pseudoStateBit("hover");
+  const auto disabled = pseudoStateBit("disabled");
+  const auto dragged = pseudoStateBit("dragged");
+  EXPECT_NE(0, dragged);
+  EXPECT_EQ(dragged, pseudoStateBit("dragged"));
+
+  auto element = [](const char* typeName, PseudoStateMask states) {
+    std::vector<AtomId> classNames;
+    appendPseudoStates(classNames, states);
+    return PathElement(internAtom(typeName), classNames);
+  };
+
+  PropertyMap pm = matchPath(mt.get(), {element("A", 0)});
+  EXPECT_EQ(1, pm.size());
+  EXPECT_EQ("red", propertyAsString(pm, "color"));
+
+  pm = matchPath(mt.get(), {element("A", hover | disabled)});
+  EXPECT_EQ(2, pm.size());
+  EXPECT_EQ("green", propertyAsString(pm, "color"));
+  EXPECT_EQ("2", propertyAsString(pm, "height"));
+
+  pm = matchPath(mt.get(), {element("A", hover), element("B", 0)});
+  EXPECT_EQ(1, pm.size());
+  EXPECT_EQ("3", propertyAsString(pm, "margin"));
+
+  pm = matchPath(mt.get(), {element("A", dragged), element("C", 0), element("B", 0)});
+  EXPECT_EQ(1, pm.size());
+  EXPECT_EQ("blue", propertyAsString(pm, "color"));
+
+  EXPECT_EQ("A:hover:disabled/B", pathToString({element("A", hover | disabled),
+                                                  element("B", 0)}));
+}
+
 //----------------------------------------------------------------------------------------
 
 TEST(StyleMatchTreeTest, rgbColors_with_percentage_value)
@@ -625,3 +822,42 @@ TEST(StyleMatchTreeTest, hslaColors)
   EXPECT_NEAR(0.13f, propertyAsColor(pm, "color").lightnessF(), 0.00001f);
   EXPECT_NEAR(0.23f, propertyAsColor(pm, "color").alphaF(), 0.00001f);
 }
+
+TEST(StyleMatchTreeTest, changedPropertyKeys)
+{
+  const auto property = [](int layer, int byteOfs, const std::string& value) {
+    return Property(SourceLocation(layer, byteOfs), PropertyValues{value});
+  };
+
+  const PropertyMap oldProps = {{"added-later", property(1, 0, "x")},
+                                {"changed", property(1, 10, "red")},
+                                {"moved", property(1, 20, "1")},
+                                {"relayered", property(0, 30, "a.png")},
+                                {"removed", property(1, 40, "2")},
+                                {"same", property(1, 50, "3")}};
+
+  EXPECT_TRUE(changedPropertyKeys(oldProps, oldProps).isEmpty());
+  EXPECT_TRUE(changedPropertyKeys(PropertyMap(), PropertyMap()).isEmpty());
+
+  auto newProps = oldProps;
+  newProps.erase("added-later");
+  newProps.erase("removed");
+  newProps["added"] = property(1, 5, "4");
+  newProps["changed"] = property(1, 10, "green");
+  // another byte offset only means that rules before it have been edited
+  newProps["moved"] = property(1, 120, "1");
+  // relative urls are resolved against the style sheet of the layer
+  newProps["relayered"] = property(1, 30, "a.png");
+
+  EXPECT_EQ((QStringList{"added", "added-later", "changed", "relayered", "removed"}),
+            changedPropertyKeys(oldProps, newProps));
+  EXPECT_EQ((QStringList{"added", "added-later", "changed", "relayered", "removed"}),
+            changedPropertyKeys(newProps, oldProps));
+
+  EXPECT_EQ((QStringList{"added-later", "changed", "moved", "relayered", "removed",
+                         "same"}),
+            changedPropertyKeys(PropertyMap(), oldProps));
+  EXPECT_EQ((QStringList{"added-later", "changed", "moved", "relayered", "removed",
+                         "same"}),
+            changedPropertyKeys(oldProps, PropertyMap()));
+}
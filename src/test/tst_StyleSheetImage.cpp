@@ -0,0 +1,182 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "StyleSheetImage.hpp"
+
+#include "CssParser.hpp"
+#include "StyleMatchTree.hpp"
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <QtCore/QString>
+#include <gtest/gtest.h>
+#include <boost/variant/get.hpp>
+RESTORE_WARNINGS
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//========================================================================================
+
+using namespace aqt::stylesheets;
+
+namespace
+{
+const std::string kSource =
+  "@font-face { src: url(\"fonts/Foo.ttf\"); }\n"
+  "A { color: red; }\n"
+  "B A.x { color: green;\n"
+  "        font: \"Arial\", \"Helvetica\"; }\n"
+  ".y { background: rgba(1, 2, 3, 0.5); }\n";
+
+std::vector<char> compileToBuffer(const std::string& src)
+{
+  auto pImage = compileStyleSheet(parseStdString(src));
+  return std::vector<char>(pImage->data(), pImage->data() + pImage->size());
+}
+
+std::string propertyAsString(PropertyMap pm, const char* pPropertyName, size_t idx = 0)
+{
+  if (const std::string* str =
+        boost::get<std::string>(&pm[QString(pPropertyName)].mValues[idx])) {
+    return *str;
+  }
+  return std::string();
+}
+} // anon namespace
+
+TEST(StyleSheetImageTest, imageRoundTripsThroughBuffer)
+{
+  auto pImage = StyleSheetImage::fromBuffer(compileToBuffer(kSource));
+  auto mt = createMatchTree(pImage, nullptr);
+
+  UiItemPath p = {PathElement("B"), PathElement("A", {"x", "y"})};
+  PropertyMap pm = matchPath(mt.get(), p);
+
+  EXPECT_EQ(3, pm.size());
+  EXPECT_EQ("green", propertyAsString(pm, "color"));
+  EXPECT_EQ("Arial", propertyAsString(pm, "font", 0));
+  EXPECT_EQ("Helvetica", propertyAsString(pm, "font", 1));
+
+  const auto& expr = boost::get<Expression>(pm[QString("background")].mValues[0]);
+  EXPECT_EQ("rgba", expr.name);
+  EXPECT_EQ((std::vector<std::string>{"1", "2", "3", "0.5"}), expr.args);
+
+  EXPECT_EQ(1, pm[QString("color")].mSourceLoc.mSourceLayer);
+  EXPECT_EQ(3, pImage->line(pm[QString("color")].mSourceLoc.mByteOfs));
+
+  EXPECT_EQ(std::vector<std::string>{"fonts/Foo.ttf"}, pImage->fontFaceUrls());
+}
+
+TEST(StyleSheetImageTest, imageMatchesLikeParsedStyleSheet)
+{
+  const std::string defaultSrc = "A { color: blue; width: 10; }\n";
+  auto fromImages =
+    createMatchTree(StyleSheetImage::fromBuffer(compileToBuffer(kSource)),
+                    StyleSheetImage::fromBuffer(compileToBuffer(defaultSrc)));
+  auto fromSources = createMatchTree(parseStdString(kSource), parseStdString(defaultSrc));
+
+  for (const auto& p : std::vector<UiItemPath>{
+         {PathElement("A")},
+         {PathElement("B"), PathElement("C"), PathElement("A", {"x"})},
+         {PathElement("Q", {"y"})}}) {
+    EXPECT_EQ(describeMatchedPath(fromSources.get(), p),
+              describeMatchedPath(fromImages.get(), p));
+  }
+
+  PropertyMap pm = matchPath(fromImages.get(), {PathElement("A")});
+  EXPECT_EQ("red", propertyAsString(pm, "color"));
+  EXPECT_EQ("10", propertyAsString(pm, "width"));
+}
+
+TEST(StyleSheetImageTest, imageIsLoadedFromFile)
+{
+  const auto buffer = compileToBuffer(kSource);
+  const std::string path = "tst_StyleSheetImage.css.bin";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(buffer.data(), std::streamsize(buffer.size()));
+  }
+
+  auto pImage = StyleSheetImage::load(QString::fromStdString(path));
+  std::remove(path.c_str());
+
+  ASSERT_EQ(buffer.size(), pImage->size());
+  EXPECT_EQ(0, std::memcmp(buffer.data(), pImage->data(), buffer.size()));
+
+  auto mt = createMatchTree(pImage, nullptr);
+  EXPECT_EQ("red", propertyAsString(matchPath(mt.get(), {PathElement("A")}), "color"));
+}
+
+TEST(StyleSheetImageTest, invalidImagesAreRejected)
+{
+  const auto buffer = compileToBuffer(kSource);
+
+  EXPECT_THROW(StyleSheetImage::fromBuffer(std::vector<char>()), ParseException);
+  EXPECT_THROW(StyleSheetImage::fromBuffer(
+                 std::vector<char>(buffer.begin(), buffer.begin() + 16)),
+               ParseException);
+  EXPECT_THROW(
+    StyleSheetImage::fromBuffer(std::vector<char>(buffer.begin(), buffer.end() - 1)),
+    ParseException);
+
+  auto badMagic = buffer;
+  badMagic[0] = 'X';
+  EXPECT_THROW(StyleSheetImage::fromBuffer(badMagic), ParseException);
+
+  auto badVersion = buffer;
+  reinterpret_cast<image::Header*>(badVersion.data())->mVersion += 1;
+  EXPECT_THROW(StyleSheetImage::fromBuffer(badVersion), ParseException);
+
+  auto badEdge = buffer;
+  const auto& header = *reinterpret_cast<const image::Header*>(badEdge.data());
+  auto* pEdges = reinterpret_cast<image::Edge*>(badEdge.data() + header.mEdges.mOffset);
+  pEdges[0].mNode = 0;
+  EXPECT_THROW(StyleSheetImage::fromBuffer(badEdge), ParseException);
+}
+
+TEST(StyleSheetImageTest, emptyStyleSheetCompilesToValidImage)
+{
+  auto pImage = StyleSheetImage::fromBuffer(compileToBuffer(""));
+  auto mt = createMatchTree(pImage, nullptr);
+
+  EXPECT_TRUE(matchPath(mt.get(), {PathElement("A")}).empty());
+}
+
+TEST(StyleSheetImageTest, selectorListsShareTheirPropertyDefinitions)
+{
+  auto pImage = compileStyleSheet(parseStdString("A, B > C, .d { color: red; }\n"
+                                                 "E { color: blue; }\n"));
+  EXPECT_EQ(2u, pImage->propertyCount());
+
+  auto mt = createMatchTree(pImage, nullptr);
+  EXPECT_EQ("red", propertyAsString(matchPath(mt.get(), {PathElement("A")}), "color"));
+  EXPECT_EQ("red", propertyAsString(matchPath(mt.get(), {PathElement("B"),
+                                                         PathElement("C")}),
+                                    "color"));
+  EXPECT_EQ("red",
+            propertyAsString(matchPath(mt.get(), {PathElement("X", {"d"})}), "color"));
+  EXPECT_EQ("blue", propertyAsString(matchPath(mt.get(), {PathElement("E")}), "color"));
+}
@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2015 Ableton AG, Berlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "StyleSnapshot.hpp"
+
+#include "CssParser.hpp"
+#include "Warnings.hpp"
+
+SUPPRESS_WARNINGS
+#include <QtGui/QColor>
+#include <gtest/gtest.h>
+RESTORE_WARNINGS
+
+#include <future>
+#include <string>
+#include <vector>
+
+//========================================================================================
+
+using namespace aqt::stylesheets;
+
+namespace
+{
+
+std::shared_ptr<StyleSnapshot> makeSnapshot(const std::string& src)
+{
+  return std::make_shared<StyleSnapshot>(createMatchTree(parseStdString(src)), 1);
+}
+
+} // anon namespace
+
+TEST(StyleSnapshotTest, typedLookup)
+{
+  const std::string src =
+    "A { color: red; width: 10; label: 'x'; pair: 1, 2; }\n"
+    "A B { width: 20; }\n";
+
+  const auto pSnapshot = makeSnapshot(src);
+  const auto* pA = internPath({PathElement("A")});
+  const auto* pAB = internPath(pA, PathElement("B"));
+
+  EXPECT_EQ(1u, pSnapshot->generation());
+  EXPECT_EQ(QColor("red"), pSnapshot->get<QColor>(pA, "color").get());
+  EXPECT_EQ(10.0, pSnapshot->get<double>(pA, "width").get());
+  EXPECT_EQ(QString("x"), pSnapshot->get<QString>(pA, "label").get());
+
+  // inherited from the parent path
+  EXPECT_EQ(QColor("red"), pSnapshot->get<QColor>(pAB, "color").get());
+  EXPECT_EQ(20.0, pSnapshot->get<double>(pAB, "width").get());
+
+  EXPECT_FALSE(pSnapshot->get<double>(pA, "missing"));
+  EXPECT_FALSE(pSnapshot->get<double>(pA, "pair"));
+  EXPECT_FALSE(pSnapshot->get<double>(pA, "label"));
+}
+
+TEST(StyleSnapshotTest, pathsWithoutOwnPropertiesShareTheirParentsMap)
+{
+  const auto pSnapshot = makeSnapshot("A { color: red; }");
+  const auto* pA = internPath({PathElement("A")});
+  const auto* pAC = internPath(pA, PathElement("C"));
+
+  EXPECT_EQ(pSnapshot->properties(pA), pSnapshot->properties(pAC));
+  EXPECT_TRUE(pSnapshot->properties(nullptr)->empty());
+}
+
+TEST(StyleSnapshotTest, prewarmResolvesAllPaths)
+{
+  std::string src;
+  std::vector<const PathNode*> paths;
+  for (int i = 0; i < 1000; ++i) {
+    const auto name = "A" + std::to_string(i);
+    src += name + " { width: " + std::to_string(i) + "; }\n";
+    paths.push_back(internPath({PathElement("Root"), PathElement(name)}));
+  }
+
+  const auto pSnapshot = makeSnapshot(src);
+  pSnapshot->prewarm(paths);
+
+  // the paths and their common parent
+  EXPECT_EQ(paths.size() + 1, pSnapshot->propertyMapCount());
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    EXPECT_EQ(double(i), pSnapshot->get<double>(paths[i], "width").get());
+  }
+  EXPECT_EQ(paths.size() + 1, pSnapshot->propertyMapCount());
+}
+
+TEST(StyleSnapshotTest, prewarmedPathsShareTheirParentsMap)
+{
+  std::vector<const PathNode*> groups;
+  std::vector<const PathNode*> paths;
+  for (int i = 0; i < 4; ++i) {
+    const auto group = "G" + std::to_string(i);
+    groups.push_back(internPath({PathElement("Root"), PathElement(group)}));
+    for (int j = 0; j < 500; ++j) {
+      paths.push_back(internPath(groups.back(), PathElement("Leaf" + std::to_string(j))));
+    }
+  }
+
+  const auto pSnapshot = makeSnapshot("Root { width: 1; } G0, G1, G2, G3 { height: 2; }");
+  pSnapshot->prewarm(paths);
+
+  // the leaves and their groups, plus the groups' common parent
+  EXPECT_EQ(paths.size() + groups.size() + 1, pSnapshot->propertyMapCount());
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    EXPECT_EQ(pSnapshot->properties(paths[i]->parent()), pSnapshot->properties(paths[i]));
+  }
+}
+
+TEST(StyleSnapshotTest, concurrentLookups)
+{
+  const auto pSnapshot = makeSnapshot("A { width: 1; } B { width: 2; }");
+
+  auto lookup = [pSnapshot](const char* type, int depth) {
+    double sum = 0;
+    const PathNode* pPath = nullptr;
+    for (int i = 0; i < depth; ++i) {
+      pPath = internPath(pPath, PathElement(i % 2 ? "A" : type));
+      sum += pSnapshot->get<double>(pPath, "width").get_value_or(0);
+    }
+    return sum;
+  };
+
+  std::vector<std::future<double>> results;
+  for (int i = 0; i < 8; ++i) {
+    results.emplace_back(std::async(std::launch::async, lookup, i % 2 ? "A" : "B", 100));
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(i % 2 ? 100.0 : 150.0, results[size_t(i)].get());
+  }
+}
+
+TEST(StyleSnapshotTest, forgetDropsCachedPaths)
+{
+  const auto pSnapshot = makeSnapshot("A { width: 1; }");
+  const auto* pA = internPath({PathElement("A")});
+
+  const auto pProps = pSnapshot->properties(pA);
+  EXPECT_EQ(1u, pSnapshot->propertyMapCount());
+  EXPECT_EQ(2u, pSnapshot->matchStateCount());
+
+  pSnapshot->forget(pA);
+  EXPECT_EQ(0u, pSnapshot->propertyMapCount());
+  EXPECT_EQ(1u, pSnapshot->matchStateCount());
+
+  // maps handed out stay valid
+  EXPECT_EQ(1u, pProps->size());
+}
+
+TEST(StyleSnapshotTest, forgetDropsAncestorsOnlyKeptForThePath)
+{
+  const auto pSnapshot = makeSnapshot("A { width: 1; } C { width: 3; }");
+  const auto* pA = internPath({PathElement("A")});
+  const auto* pAB = internPath(pA, PathElement("B"));
+  const auto* pABC = internPath(pAB, PathElement("C"));
+
+  pSnapshot->properties(pA);
+  pSnapshot->properties(pABC);
+  EXPECT_EQ(3u, pSnapshot->propertyMapCount());
+
+  // A has been requested on its own, B only on the way to C
+  pSnapshot->forget(pABC);
+  EXPECT_EQ(1u, pSnapshot->propertyMapCount());
+  EXPECT_EQ(2u, pSnapshot->matchStateCount());
+
+  pSnapshot->forget(pA);
+  EXPECT_EQ(0u, pSnapshot->propertyMapCount());
+  EXPECT_EQ(1u, pSnapshot->matchStateCount());
+}
+
+TEST(StyleSnapshotTest, forgetKeepsPathsWithCachedChildren)
+{
+  const auto pSnapshot = makeSnapshot("A { width: 1; } B { width: 2; }");
+  const auto* pA = internPath({PathElement("A")});
+  const auto* pAB = internPath(pA, PathElement("B"));
+
+  pSnapshot->properties(pA);
+  pSnapshot->properties(pAB);
+
+  pSnapshot->forget(pA);
+  EXPECT_EQ(2u, pSnapshot->propertyMapCount());
+
+  pSnapshot->forget(pAB);
+  EXPECT_EQ(0u, pSnapshot->propertyMapCount());
+  EXPECT_EQ(1u, pSnapshot->matchStateCount());
+}
+
+TEST(StyleSnapshotTest, cacheReturnsToItsBaselineAfterChurn)
+{
+  const auto pSnapshot = makeSnapshot("Item { width: 1; } Label { width: 2; }");
+  const auto* pRoot = internPath({PathElement("Root")});
+
+  pSnapshot->properties(pRoot);
+  const auto propertyMapCount = pSnapshot->propertyMapCount();
+  const auto matchStateCount = pSnapshot->matchStateCount();
+
+  // items come and go below intermediate items which don't have a StyleSet
+  for (int round = 0; round < 10; ++round) {
+    std::vector<const PathNode*> paths;
+    for (int i = 0; i < 200; ++i) {
+      const auto* pPanel = internPath(pRoot, PathElement("Panel" + std::to_string(i)));
+      const auto* pItem = internPath(pPanel, PathElement("Item"));
+      paths.push_back(internPath(pItem, PathElement("Label")));
+    }
+
+    if (round % 2) {
+      pSnapshot->prewarm(paths);
+    } else {
+      for (const auto* pPath : paths) {
+        pSnapshot->properties(pPath);
+      }
+    }
+    EXPECT_LT(propertyMapCount, pSnapshot->propertyMapCount());
+
+    for (const auto* pPath : paths) {
+      pSnapshot->forget(pPath);
+    }
+    EXPECT_EQ(propertyMapCount, pSnapshot->propertyMapCount());
+    EXPECT_EQ(matchStateCount, pSnapshot->matchStateCount());
+  }
+}
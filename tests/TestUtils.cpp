@@ -37,6 +37,7 @@ namespace tests
 void TestUtilsPlugin::registerTypes(const char* uri)
 {
   qmlRegisterType<MsgTracker>(uri, 1, 0, "MsgTracker");
+  qmlRegisterType<TemporaryFiles>(uri, 1, 0, "TemporaryFiles");
 }
 
 } // namespace tests
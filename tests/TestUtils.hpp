@@ -25,9 +25,14 @@ THE SOFTWARE.
 #include "../src/Warnings.hpp"
 
 SUPPRESS_WARNINGS
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
 #include <QtCore/QObject>
 #include <QtCore/QRegularExpression>
 #include <QtCore/QString>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QUrl>
 #include <QtCore/QVariant>
 #include <QtQml/QQmlExtensionPlugin>
 #include <QtTest/QTest>
@@ -68,6 +73,35 @@ class MsgTracker : public QObject
   }
 };
 
+//! Files in a temporary directory, which is removed along with the object
+class TemporaryFiles : public QObject
+{
+  Q_OBJECT
+
+public:
+  TemporaryFiles(QObject* pParent = nullptr)
+    : QObject(pParent)
+  {
+  }
+
+  //! Writes @p content to the file @p fileName in place and returns its url
+  Q_INVOKABLE QUrl write(const QString& fileName, const QString& content)
+  {
+    const auto filePath = QDir(mDir.path()).filePath(fileName);
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(content.toUtf8()) < 0) {
+      qWarning() << "Could not write" << filePath;
+    }
+
+    return QUrl::fromLocalFile(filePath);
+  }
+
+private:
+  QTemporaryDir mDir;
+};
+
 class TestUtilsPlugin : public QQmlExtensionPlugin
 {
   Q_OBJECT
@@ -0,0 +1,110 @@
+// Copyright (c) 2015 Ableton AG, Berlin
+
+import QtQuick 2.3
+import QtTest 1.0
+
+import Aqt.StyleSheets 1.2
+import Aqt.Testing 1.0 as AqtTests
+
+Item {
+    id: scene
+
+    /*! ensure minimum width to be larger than the minimum allowed width on
+     * Windows */
+    implicitWidth: 124
+    /*! there are no constraints on the height, but it is convenient to have a
+     *  default size */
+    implicitHeight: 116
+
+
+    StyleEngine {
+        id: styleEngine
+        styleSheetSource: "reload-a.css"
+    }
+
+    Component {
+        id: churnScene
+
+        Rectangle {
+            property string styleName
+            StyleSet.name: styleName
+            color: StyleSet.props.color("color")
+        }
+    }
+
+    //! creates and destroys @p count items with StyleSet names not used before
+    function churn(prefix, count) {
+        for (var i = 0; i < count; ++i) {
+            AqtTests.Utils.withComponent(churnScene, scene,
+                                         { styleName: prefix + i }, function(comp) {
+                verify(comp.StyleSet.props !== null);
+            });
+        }
+        // let the deferred deletes run
+        wait(0);
+    }
+
+
+    //--------------------------------------------------------------------------
+
+    TestCase {
+        name: "cache bounds"
+        when: windowShown
+
+        //! the engine's kMaxUnusedStyleSetProps
+        readonly property int maxUnusedStyleSetProps: 256
+
+        function cleanup() {
+            styleEngine.styleSheetSource = "reload-a.css";
+        }
+
+        function test_unusedPropsAreBounded() {
+            var before = styleEngine.cacheCounters();
+
+            churn("first-", maxUnusedStyleSetProps * 2);
+            var afterFirst = styleEngine.cacheCounters();
+            compare(afterFirst.liveStyleSetProps, before.liveStyleSetProps);
+            compare(afterFirst.unusedStyleSetProps, maxUnusedStyleSetProps);
+
+            // a second round of new paths replaces the kept ones instead of
+            // adding to them
+            churn("second-", maxUnusedStyleSetProps * 2);
+            var afterSecond = styleEngine.cacheCounters();
+            compare(afterSecond.liveStyleSetProps, before.liveStyleSetProps);
+            compare(afterSecond.unusedStyleSetProps, maxUnusedStyleSetProps);
+            compare(afterSecond.propertyMaps, afterFirst.propertyMaps);
+            compare(afterSecond.matchStates, afterFirst.matchStates);
+
+            // only the process wide tables grow with the new names
+            verify(afterSecond.atoms > afterFirst.atoms);
+        }
+
+        function test_recreatedItemsReuseTheirPaths() {
+            churn("recreated-", 10);
+            var before = styleEngine.cacheCounters();
+
+            churn("recreated-", 10);
+            compare(styleEngine.cacheCounters().internedPaths, before.internedPaths);
+            compare(styleEngine.cacheCounters().atoms, before.atoms);
+        }
+
+        function test_unusedPropsAreKeptOverReloads() {
+            AqtTests.Utils.withComponent(churnScene, scene,
+                                         { styleName: "changing" }, function(comp) {
+                verify(Qt.colorEqual(comp.color, "red"));
+            });
+            wait(0);
+            var before = styleEngine.cacheCounters();
+
+            styleEngine.styleSheetSource = "reload-b.css";
+            compare(styleEngine.cacheCounters().unusedStyleSetProps,
+                    before.unusedStyleSetProps);
+
+            // the kept props are resolved again when they are reused
+            AqtTests.Utils.withComponent(churnScene, scene,
+                                         { styleName: "changing" }, function(comp) {
+                verify(Qt.colorEqual(comp.color, "green"));
+            });
+        }
+    }
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2015 Ableton AG, Berlin
+
+import QtQuick 2.3
+import QtTest 1.0
+
+import Aqt.StyleSheets 1.2
+import Aqt.Testing 1.0 as AqtTests
+
+Item {
+    id: scene
+
+    /*! ensure minimum width to be larger than the minimum allowed width on
+     * Windows */
+    implicitWidth: 124
+    /*! there are no constraints on the height, but it is convenient to have a
+     *  default size */
+    implicitHeight: 116
+
+
+    AqtTests.MsgTracker {
+        id: msgTracker
+    }
+
+    AqtTests.TemporaryFiles {
+        id: tempFiles
+    }
+
+    StyleEngine {
+        id: styleEngine
+        styleSheetSource: "reload-a.css"
+    }
+
+    SignalSpy {
+        id: styleChangedSpy
+        target: styleEngine
+        signalName: "styleChanged"
+    }
+
+    Component {
+        id: loadingScene
+
+        Rectangle {
+            StyleSet.name: "changing"
+            color: StyleSet.props.color("color")
+        }
+    }
+
+    function sheet(color) {
+        return ".changing { color: \"" + color + "\"; }\n";
+    }
+
+
+    //--------------------------------------------------------------------------
+
+    TestCase {
+        name: "asynchronous loading"
+        when: windowShown
+
+        function cleanup() {
+            styleEngine.asyncLoading = false;
+            styleEngine.styleSheetSource = "reload-a.css";
+        }
+
+        function test_swapsInTheNewStyles() {
+            AqtTests.Utils.withComponent(loadingScene, scene, {}, function(comp) {
+                styleEngine.asyncLoading = true;
+                styleChangedSpy.clear();
+
+                styleEngine.styleSheetSource = "reload-b.css";
+                // the old styles stay in place until the new ones are loaded
+                verify(Qt.colorEqual(comp.color, "red"));
+                compare(styleChangedSpy.count, 0);
+
+                styleChangedSpy.wait();
+                verify(Qt.colorEqual(comp.color, "green"));
+            });
+        }
+
+        function test_reloadRequestedWhileLoadingRestarts() {
+            AqtTests.Utils.withComponent(loadingScene, scene, {}, function(comp) {
+                styleEngine.asyncLoading = true;
+                styleChangedSpy.clear();
+
+                styleEngine.styleSheetSource = "reload-b.css";
+                styleEngine.styleSheetSource = "reload-c.css";
+
+                // the outdated result of the first load is dropped
+                styleChangedSpy.wait();
+                wait(50);
+                compare(styleChangedSpy.count, 1);
+                verify(Qt.colorEqual(comp.color, "yellow"));
+            });
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+
+    TestCase {
+        name: "reloading changed files"
+        when: windowShown
+
+        function cleanup() {
+            styleEngine.reloadDelay = 100;
+            styleEngine.styleSheetSource = "reload-a.css";
+        }
+
+        function test_fileChangesAreCollected() {
+            AqtTests.Utils.withComponent(loadingScene, scene, {}, function(comp) {
+                styleEngine.reloadDelay = 200;
+                styleEngine.styleSheetSource = tempFiles.write("collect.css",
+                                                               sheet("red"));
+                verify(Qt.colorEqual(comp.color, "red"));
+                styleChangedSpy.clear();
+
+                tempFiles.write("collect.css", sheet("green"));
+                wait(20);
+                tempFiles.write("collect.css", sheet("blue"));
+
+                styleChangedSpy.wait();
+                wait(styleEngine.reloadDelay * 2);
+                compare(styleChangedSpy.count, 1);
+                verify(Qt.colorEqual(comp.color, "blue"));
+            });
+        }
+
+        function test_unchangedFileIsNotReloaded() {
+            AqtTests.Utils.withComponent(loadingScene, scene, {}, function(comp) {
+                styleEngine.reloadDelay = 20;
+                styleEngine.styleSheetSource = tempFiles.write("unchanged.css",
+                                                               sheet("red"));
+                styleChangedSpy.clear();
+
+                // the reload happens, but finds the content unchanged
+                msgTracker.expectMessage(AqtTests.MsgTracker.Debug,
+                                         /^INFO:.*unchanged\.css.*is unchanged/);
+                tempFiles.write("unchanged.css", sheet("red"));
+
+                wait(styleEngine.reloadDelay * 10);
+                compare(styleChangedSpy.count, 0);
+                verify(Qt.colorEqual(comp.color, "red"));
+            });
+        }
+
+        function test_compiledImageIsWatched() {
+            AqtTests.Utils.withComponent(loadingScene, scene, {}, function(comp) {
+                styleEngine.reloadDelay = 20;
+                tempFiles.write("image.css.bin", "no image");
+                styleEngine.styleSheetSource = tempFiles.write("image.css",
+                                                               sheet("red"));
+                verify(Qt.colorEqual(comp.color, "red"));
+
+                // the changed image is loaded, found broken and ignored
+                msgTracker.expectMessage(AqtTests.MsgTracker.Warning,
+                                         /^WARN:.*Ignoring.*image\.css\.bin/);
+                tempFiles.write("image.css.bin", "still no image");
+
+                wait(styleEngine.reloadDelay * 10);
+                verify(Qt.colorEqual(comp.color, "red"));
+            });
+        }
+    }
+}
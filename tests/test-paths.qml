@@ -37,6 +37,11 @@ Item {
         signalName: "exception"
     }
 
+    SignalSpy {
+        id: propsSpy
+        signalName: "propsChanged"
+    }
+
     Component {
         id: minimalCase
 
@@ -144,4 +149,190 @@ Item {
             compare(spy.count, 0);
         }
     }
+
+
+    //--------------------------------------------------------------------------
+
+    Component {
+        id: classToggleCase
+
+        Item {
+            property alias rect: rectObj
+            property alias textValue: textObj.text
+
+            Rectangle {
+                id: rectObj
+                StyleSet.name: "root"
+                anchors.fill: parent
+
+                Text {
+                    id: textObj
+                    text: StyleSet.props.get("text")
+                }
+            }
+        }
+    }
+
+    TestCase {
+        name: "toggling style classes updates descendants"
+        when: windowShown
+
+        function test_toggleClass() {
+            AqtTests.Utils.withComponent(classToggleCase, scene, {}, function(comp) {
+                compare(comp.textValue, "B");
+
+                comp.rect.StyleSet.setClass("selected", true);
+                verify(comp.rect.StyleSet.hasClass("selected"));
+                compare(comp.rect.StyleSet.name, "root selected");
+                compare(comp.textValue, "S");
+
+                comp.rect.StyleSet.setClass("selected", false);
+                verify(!comp.rect.StyleSet.hasClass("selected"));
+                compare(comp.rect.StyleSet.name, "root");
+                compare(comp.textValue, "B");
+            });
+        }
+
+        function test_classChangesNotifyOnlyIfPropertiesChange() {
+            AqtTests.Utils.withComponent(classToggleCase, scene, {}, function(comp) {
+                propsSpy.target = comp.rect.StyleSet;
+                propsSpy.clear();
+
+                // no rule matches the new class
+                comp.rect.StyleSet.setClass("unstyled", true);
+                verify(comp.rect.StyleSet.hasClass("unstyled"));
+                compare(propsSpy.count, 0);
+
+                comp.rect.StyleSet.setClass("selected", true);
+                compare(propsSpy.count, 1);
+
+                verify(!comp.rect.StyleSet.hasClass("never-set"));
+            });
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+
+    Component {
+        id: valuesCase
+
+        Rectangle {
+            property var textValue: StyleSet.values.text
+            StyleSet.name: "root"
+        }
+    }
+
+    TestCase {
+        name: "values map follows the style properties"
+        when: windowShown
+
+        function test_values() {
+            AqtTests.Utils.withComponent(valuesCase, scene, {}, function(comp) {
+                compare(comp.textValue, "B");
+
+                comp.StyleSet.setClass("selected", true);
+                compare(comp.textValue, "S");
+
+                comp.StyleSet.name = "";
+                compare(comp.textValue, undefined);
+            });
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+
+    Component {
+        id: reparentCase
+
+        Item {
+            property alias subtree: subtreeObj
+            property alias other: otherObj
+            property alias leaf: leafObj
+
+            Rectangle {
+                StyleSet.name: "root"
+
+                // carries no StyleSet of its own
+                Item {
+                    id: subtreeObj
+
+                    Foo.C {
+                        id: leafObj
+                        property var textValue: StyleSet.props.get("text")
+                    }
+                }
+            }
+
+            Rectangle {
+                id: otherObj
+                StyleSet.name: "other"
+            }
+        }
+    }
+
+    TestCase {
+        name: "reparenting a subtree updates the StyleSets in it"
+        when: windowShown
+
+        function test_reparentSubtree() {
+            AqtTests.Utils.withComponent(reparentCase, scene, {}, function(comp) {
+                compare(comp.leaf.textValue, "B");
+
+                var oldParent = comp.subtree.parent;
+                comp.subtree.parent = comp.other;
+                compare(comp.leaf.textValue, "O");
+
+                comp.subtree.parent = oldParent;
+                compare(comp.leaf.textValue, "B");
+            });
+        }
+    }
+
+
+    //--------------------------------------------------------------------------
+
+    Component {
+        id: intermediateCase
+
+        Rectangle {
+            property alias middle: middleObj
+            property alias leaf: leafObj
+
+            StyleSet.name: "root"
+
+            // gets its StyleSet only when the test accesses it
+            Item {
+                id: middleObj
+
+                Item {
+                    Foo.C {
+                        id: leafObj
+                        property var textValue: StyleSet.props.get("text")
+                    }
+                }
+            }
+        }
+    }
+
+    TestCase {
+        name: "StyleSets created on ancestors later are taken into account"
+        when: windowShown
+
+        function test_intermediateStyleSet() {
+            AqtTests.Utils.withComponent(intermediateCase, scene, {}, function(comp) {
+                compare(comp.leaf.textValue, "B");
+
+                comp.middle.StyleSet.name = "marked";
+                compare(comp.leaf.textValue, "M");
+
+                comp.middle.StyleSet.setClass("marked", false);
+                compare(comp.leaf.textValue, "B");
+
+                comp.middle.StyleSet.setClass("marked", true);
+                compare(comp.leaf.textValue, "M");
+            });
+        }
+    }
 }
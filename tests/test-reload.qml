@@ -0,0 +1,131 @@
+// Copyright (c) 2015 Ableton AG, Berlin
+
+import QtQuick 2.3
+import QtTest 1.0
+
+import Aqt.StyleSheets 1.2
+import Aqt.Testing 1.0 as AqtTests
+
+Item {
+    id: scene
+
+    /*! ensure minimum width to be larger than the minimum allowed width on
+     * Windows */
+    implicitWidth: 124
+    /*! there are no constraints on the height, but it is convenient to have a
+     *  default size */
+    implicitHeight: 116
+
+
+    StyleEngine {
+        id: styleEngine
+        styleSheetSource: "reload-a.css"
+    }
+
+    Component {
+        id: reloadScene
+
+        Item {
+            property alias changing: changingRect
+            property alias constant: constantRect
+            property alias unread: unreadItem
+            property alias readOnce: readOnceItem
+
+            Rectangle {
+                id: changingRect
+                StyleSet.name: "changing"
+                color: StyleSet.props.color("color")
+            }
+
+            Rectangle {
+                id: constantRect
+                StyleSet.name: "constant"
+                color: StyleSet.props.color("color")
+            }
+
+            // nothing ever reads its properties
+            Item {
+                id: unreadItem
+                StyleSet.name: "changing"
+            }
+
+            // its properties are only read by the test
+            Item {
+                id: readOnceItem
+                StyleSet.name: "changing read-once"
+            }
+        }
+    }
+
+    SignalSpy {
+        id: changingSpy
+        signalName: "propsChanged"
+    }
+
+    SignalSpy {
+        id: constantSpy
+        signalName: "propsChanged"
+    }
+
+    SignalSpy {
+        id: unreadSpy
+        signalName: "propsChanged"
+    }
+
+    TestCase {
+        name: "reloading notifies the StyleSets whose properties may have changed"
+        when: windowShown
+
+        function cleanup() {
+            styleEngine.styleSheetSource = "reload-a.css";
+            styleEngine.lazyReload = false;
+        }
+
+        function test_reload_data() {
+            return [
+                { tag: "eager", lazy: false, constantNotifications: 0,
+                  unreadNotifications: 1, readOnceResolved: true },
+                { tag: "lazy", lazy: true, constantNotifications: 1,
+                  unreadNotifications: 0, readOnceResolved: false }
+            ];
+        }
+
+        function test_reload(data) {
+            styleEngine.lazyReload = data.lazy;
+
+            AqtTests.Utils.withComponent(reloadScene, scene, {}, function(comp) {
+                verify(Qt.colorEqual(comp.changing.color, "red"));
+                verify(Qt.colorEqual(comp.constant.color, "blue"));
+                verify(Qt.colorEqual(comp.readOnce.StyleSet.props.color("color"), "red"));
+
+                changingSpy.target = comp.changing.StyleSet;
+                constantSpy.target = comp.constant.StyleSet;
+                unreadSpy.target = comp.unread.StyleSet;
+                changingSpy.clear();
+                constantSpy.clear();
+                unreadSpy.clear();
+
+                styleEngine.styleSheetSource = "reload-b.css";
+
+                // the constant rule has moved, but kept its values.  In lazy
+                // mode this isn't known before its binding resolves it again.
+                compare(changingSpy.count, 1);
+                compare(constantSpy.count, data.constantNotifications);
+                // in lazy mode properties nobody has read are not resolved
+                // again, so there is nothing to notify
+                compare(unreadSpy.count, data.unreadNotifications);
+
+                // properties read before the reload, but not since, are only
+                // resolved when they are read again in lazy mode
+                var resolvedPaths = styleEngine.cacheCounters().propertyMaps;
+                verify(Qt.colorEqual(comp.readOnce.StyleSet.props.color("color"), "green"));
+                compare(styleEngine.cacheCounters().propertyMaps,
+                        resolvedPaths + (data.readOnceResolved ? 0 : 1));
+
+                verify(Qt.colorEqual(comp.changing.color, "green"));
+                verify(Qt.colorEqual(comp.constant.color, "blue"));
+                verify(Qt.colorEqual(comp.unread.StyleSet.props.color("color"), "green"));
+            });
+        }
+    }
+}